@@ -1,34 +1,383 @@
+from esphome import automation
+import copy
+import re
+
 import esphome.codegen as cg
 from esphome.components import uart
 import esphome.config_validation as cv
-from esphome.const import CONF_ID
+from esphome.const import (
+    CONF_ADDRESS,
+    CONF_BAUD_RATE,
+    CONF_ID,
+    CONF_INTERNAL,
+    CONF_NAME,
+    CONF_PLATFORM,
+    CONF_PORT,
+    CONF_PROTOCOL,
+    CONF_TRIGGER_ID,
+    CONF_TYPE,
+    CONF_UPDATE_INTERVAL,
+)
+from esphome.core import CORE
 
 # CODEOWNERS = ["@0hax"]
 
 mk2pvrouter_ns = cg.esphome_ns.namespace("mk2pvrouter")
 Mk2PVRouter = mk2pvrouter_ns.class_("Mk2PVRouter", cg.PollingComponent, uart.UARTDevice)
+Mk2PVRouterInput = mk2pvrouter_ns.class_("Mk2PVRouterInput", uart.UARTDevice)
+StreamSink = mk2pvrouter_ns.class_("StreamSink")
+FrameSnapshot = mk2pvrouter_ns.struct("FrameSnapshot")
+FrameSnapshotConstRef = FrameSnapshot.operator("ref").operator("const")
+FrameTrigger = mk2pvrouter_ns.class_("FrameTrigger", automation.Trigger.template(FrameSnapshotConstRef))
 
 CONF_MK2PVROUTER_ID = "mk2pvrouter_id"
 CONF_TAG_NAME = "tag_name"
+CONF_CHECKSUM_MODE = "checksum_mode"
+CONF_CONTINUOUS = "continuous"
+CONF_AGGREGATE = "aggregate"
+CONF_PUBLISH_ON_CHANGE = "publish_on_change"
+CONF_MAX_BYTES_PER_LOOP = "max_bytes_per_loop"
+CONF_MAX_TIME_PER_LOOP = "max_time_per_loop"
+CONF_ADAPTIVE_BUDGET = "adaptive_budget"
+CONF_READER_TASK = "reader_task"
+CONF_VERIFY_ALL_CRC = "verify_all_crc"
+CONF_MAX_VALUE_LENGTH = "max_value_length"
+CONF_INPUTS = "inputs"
+CONF_MAX_PUBLISH_PER_LOOP = "max_publish_per_loop"
+CONF_ROUTER_ID = "router_id"
+CONF_ON_FRAME = "on_frame"
+CONF_STREAM = "stream"
+CONF_MTU = "mtu"
+CONF_FLUSH_INTERVAL = "flush_interval"
+CONF_TAGS = "tags"
+CONF_BINARY = "binary"
+CONF_STALE_TIMEOUT = "stale_timeout"
+CONF_PROFILE = "profile"
+CONF_INDEXES = "indexes"
+CONF_LAZY = "lazy"
+# Listeners of the other indexes of an indexed subscription, set by its validation
+CONF_INDEXED = "indexed"
+CONF_MAX_GROUPS = "max_groups"
+CONF_TAG_ID = "tag_id"
+
+# Additional UART inputs of a hub, beside its own UART
+MAX_INPUTS = 15
+
+# Replaced by each index in the tag_name and the name of an indexed subscription
+INDEX_PLACEHOLDER = "{}"
+
+# Digits and sign of a 32 bits value of the binary frames
+BINARY_VALUE_LENGTH = 11
+
+# Platforms of the listeners, whose tags size the parser tag buffer
+LISTENER_DOMAINS = ["sensor", "binary_sensor", "text_sensor"]
+
+ChecksumMode = mk2pvrouter_ns.enum("ChecksumMode", is_class=True)
+CHECKSUM_MODES = {
+    "standard": ChecksumMode.STANDARD,
+    "historical": ChecksumMode.HISTORICAL,
+}
+
+Aggregate = mk2pvrouter_ns.enum("Aggregate", is_class=True)
+AGGREGATES = {
+    "last": Aggregate.LAST,
+    "mean": Aggregate.MEAN,
+    "min": Aggregate.MIN,
+    "max": Aggregate.MAX,
+}
+
+StreamProtocol = mk2pvrouter_ns.enum("StreamProtocol", is_class=True)
+STREAM_PROTOCOLS = {
+    "udp": StreamProtocol.UDP,
+    "tcp": StreamProtocol.TCP,
+}
+
+# Generates a milliseconds setter argument, unlike cv.positive_not_null_time_period
+positive_not_null_time_period_milliseconds = cv.All(
+    cv.positive_time_period_milliseconds, cv.Range(min=cv.TimePeriod(milliseconds=1))
+)
 
 MK2PVROUTER_LISTENER_SCHEMA = cv.Schema(
     {
         cv.GenerateID(CONF_MK2PVROUTER_ID): cv.use_id(Mk2PVRouter),
+        cv.Required(CONF_TAG_NAME): cv.All(cv.string, cv.Length(min=1, max=254)),
+        cv.Optional(CONF_UPDATE_INTERVAL): positive_not_null_time_period_milliseconds,
+        cv.Optional(CONF_AGGREGATE): cv.enum(AGGREGATES, lower=True),
+        cv.Optional(CONF_ROUTER_ID): cv.use_id(Mk2PVRouterInput),
+    }
+)
+
+
+def validate_indexes(config):
+    """A tag_name placeholder is only replaced in an indexed subscription, see indexed_listener_schema()."""
+    if INDEX_PLACEHOLDER in config[CONF_TAG_NAME]:
+        raise cv.Invalid(f"The {INDEX_PLACEHOLDER} placeholder of {CONF_TAG_NAME} requires {CONF_INDEXES}")
+    return config
+
+
+def validate_lazy(config):
+    """A lazy listener never publishes, so it is internal: as an entity, it would stay unknown forever."""
+    if not config[CONF_LAZY]:
+        return config
+    if not config.get(CONF_INTERNAL, True):
+        raise cv.Invalid(f"A {CONF_LAZY} listener never publishes, it must be {CONF_INTERNAL}")
+    config[CONF_INTERNAL] = True
+    return config
+
+
+INDEXED_SUBSCRIPTION_SCHEMA = cv.Schema(
+    {
         cv.Required(CONF_TAG_NAME): cv.string,
+        cv.Required(CONF_INDEXES): cv.All(cv.ensure_list(cv.All(cv.string, cv.Length(min=1))), cv.Length(min=1)),
+        cv.Optional(CONF_ID): cv.string,
+        cv.Optional(CONF_NAME): cv.string,
+    },
+    extra=cv.ALLOW_EXTRA,
+)
+
+
+def indexed_listener_schema(schema):
+    """Validates a listener, or an indexed subscription such as P{} with indexes 1 to 3, for P1 to P3.
+
+    Each index gets its own copy of the configuration, validated on its own before the IDs are resolved, so that
+    every copy declares its own generated IDs (MQTT, filters, automations), and its id, suffixed with the index,
+    can be used in lambdas. The copy of the first index is the configuration, the others are under CONF_INDEXED.
+    """
+
+    def validator(value):
+        if not isinstance(value, dict) or CONF_INDEXES not in value:
+            return schema(value)
+        indexed = INDEXED_SUBSCRIPTION_SCHEMA(value)
+        tag_name = indexed[CONF_TAG_NAME]
+        indexes = indexed[CONF_INDEXES]
+        if tag_name.count(INDEX_PLACEHOLDER) != 1:
+            raise cv.Invalid(f"{CONF_TAG_NAME} must contain the {INDEX_PLACEHOLDER} placeholder once")
+        if len(set(indexes)) != len(indexes):
+            raise cv.Invalid(f"{CONF_INDEXES} must be unique")
+
+        listeners = []
+        for index in indexes:
+            conf = copy.deepcopy({key: val for key, val in value.items() if key != CONF_INDEXES})
+            conf[CONF_TAG_NAME] = tag_name.replace(INDEX_PLACEHOLDER, index)
+            if CONF_ID in indexed:
+                conf[CONF_ID] = f"{indexed[CONF_ID]}_{re.sub(r'[^a-zA-Z0-9_]', '_', index)}"
+            name = indexed.get(CONF_NAME)
+            if name:
+                conf[CONF_NAME] = name.replace(INDEX_PLACEHOLDER, index) if INDEX_PLACEHOLDER in name else f"{name} {index}"
+            listeners.append(schema(conf))
+        config = listeners[0]
+        config[CONF_INDEXED] = listeners[1:]
+        return config
+
+    return validator
+
+
+def expand_indexes(config):
+    """Yields the configuration of each listener of an indexed subscription, or the configuration itself."""
+    yield config
+    for conf in config.get(CONF_INDEXED, []):
+        # Popped by cv.typed_schema() around the validation of each copy, only set back on the first one
+        if CONF_TYPE in config:
+            conf[CONF_TYPE] = config[CONF_TYPE]
+        yield conf
+
+
+INPUT_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(): cv.declare_id(Mk2PVRouterInput),
+    }
+).extend(uart.UART_DEVICE_SCHEMA)
+
+
+STREAM_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(StreamSink),
+            cv.Optional(CONF_PROTOCOL, default="udp"): cv.enum(STREAM_PROTOCOLS, lower=True),
+            cv.Required(CONF_ADDRESS): cv.ipv4address,
+            cv.Required(CONF_PORT): cv.port,
+            # Payload of an Ethernet frame, less the IPv4 and UDP headers
+            cv.Optional(CONF_MTU, default=1400): cv.int_range(min=64, max=1472),
+            cv.Optional(CONF_FLUSH_INTERVAL, default="1s"): cv.positive_time_period_milliseconds,
+            # Forward every group by default
+            cv.Optional(CONF_TAGS): cv.ensure_list(cv.All(cv.string, cv.Length(min=1, max=254))),
+        }
+    ),
+    cv.requires_component("socket"),
+)
+
+
+def validate_unique_tag_ids(value):
+    ids = [conf[CONF_TAG_ID] for conf in value]
+    for tag_id in ids:
+        if ids.count(tag_id) > 1:
+            raise cv.Invalid(f"Tag ID {tag_id} is named more than once")
+    return value
+
+
+BINARY_TAG_SCHEMA = cv.Schema(
+    {
+        cv.Required(CONF_TAG_ID): cv.int_range(min=0, max=255),
+        cv.Required(CONF_TAG_NAME): cv.All(cv.string, cv.Length(min=1, max=254)),
     }
 )
 
-CONFIG_SCHEMA = (
+BINARY_SCHEMA = cv.Schema(
+    {
+        # The groups of a binary frame are buffered until its CRC is checked
+        cv.Optional(CONF_MAX_GROUPS, default=32): cv.int_range(min=1, max=255),
+        cv.Required(CONF_TAGS): cv.All(cv.ensure_list(BINARY_TAG_SCHEMA), cv.Length(min=1), validate_unique_tag_ids),
+    }
+)
+
+
+def validate_stale_timeout(config):
+    # Outside of continuous mode, a frame is only parsed after each update
+    if (
+        CONF_STALE_TIMEOUT in config
+        and not config[CONF_CONTINUOUS]
+        and config[CONF_STALE_TIMEOUT] <= config[CONF_UPDATE_INTERVAL]
+    ):
+        raise cv.Invalid(f"{CONF_STALE_TIMEOUT} must be longer than {CONF_UPDATE_INTERVAL} outside of continuous mode")
+    return config
+
+
+def validate_binary(config):
+    if CONF_BINARY in config and config[CONF_MAX_VALUE_LENGTH] < BINARY_VALUE_LENGTH:
+        raise cv.Invalid(f"{CONF_MAX_VALUE_LENGTH} must be at least {BINARY_VALUE_LENGTH} to receive binary frames")
+    return config
+
+
+async def register_mk2pvrouter_listener(var, config):
+    mk2pvrouter = await cg.get_variable(config[CONF_MK2PVROUTER_ID])
+    cg.add(mk2pvrouter.register_mk2pvrouter_listener(var))
+    if CONF_UPDATE_INTERVAL in config:
+        cg.add(var.set_update_interval(config[CONF_UPDATE_INTERVAL]))
+    if CONF_AGGREGATE in config:
+        cg.add(var.set_aggregate(config[CONF_AGGREGATE]))
+    if CONF_ROUTER_ID in config:
+        router = await cg.get_variable(config[CONF_ROUTER_ID])
+        cg.add(var.set_input(router))
+    return mk2pvrouter
+
+CONFIG_SCHEMA = cv.All(
     cv.Schema(
         {
             cv.GenerateID(): cv.declare_id(Mk2PVRouter),
+            cv.Optional(CONF_BAUD_RATE): cv.int_range(min=1),
+            cv.Optional(CONF_CHECKSUM_MODE, default="standard"): cv.enum(CHECKSUM_MODES, lower=True),
+            cv.Optional(CONF_CONTINUOUS, default=False): cv.boolean,
+            cv.Optional(CONF_AGGREGATE, default="last"): cv.enum(AGGREGATES, lower=True),
+            cv.Optional(CONF_PUBLISH_ON_CHANGE, default=False): cv.boolean,
+            cv.Optional(CONF_MAX_BYTES_PER_LOOP, default=128): cv.int_range(min=1, max=4096),
+            cv.Optional(CONF_MAX_TIME_PER_LOOP): cv.positive_time_period_microseconds,
+            cv.Optional(CONF_ADAPTIVE_BUDGET, default=False): cv.boolean,
+            cv.Optional(CONF_READER_TASK): cv.All(cv.only_on_esp32, cv.boolean),
+            cv.Optional(CONF_VERIFY_ALL_CRC, default=False): cv.boolean,
+            cv.Optional(CONF_MAX_VALUE_LENGTH, default=15): cv.int_range(min=1, max=254),
+            cv.Optional(CONF_MAX_PUBLISH_PER_LOOP): cv.int_range(min=1, max=65535),
+            cv.Optional(CONF_STALE_TIMEOUT): positive_not_null_time_period_milliseconds,
+            cv.Optional(CONF_PROFILE): positive_not_null_time_period_milliseconds,
+            cv.Optional(CONF_INPUTS): cv.All(cv.ensure_list(INPUT_SCHEMA), cv.Length(max=MAX_INPUTS)),
+            cv.Optional(CONF_STREAM): STREAM_SCHEMA,
+            cv.Optional(CONF_BINARY): BINARY_SCHEMA,
+            cv.Optional(CONF_ON_FRAME): automation.validate_automation(
+                {
+                    cv.GenerateID(CONF_TRIGGER_ID): cv.declare_id(FrameTrigger),
+                }
+            ),
         }
     )
     .extend(cv.polling_component_schema("5s"))
-    .extend(uart.UART_DEVICE_SCHEMA)
+    .extend(uart.UART_DEVICE_SCHEMA),
+    validate_binary,
+    validate_stale_timeout,
 )
 
+
+def _final_validate(config):
+    if CONF_BAUD_RATE not in config:
+        return config
+    validate_uart = uart.final_validate_device_schema(
+        "mk2pvrouter",
+        baud_rate=config[CONF_BAUD_RATE],
+        require_rx=True,
+        data_bits=8,
+        parity="NONE",
+        stop_bits=1,
+    )
+    for conf in config.get(CONF_INPUTS, []):
+        validate_uart(conf)
+    return validate_uart(config)
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+
+def _listened_tags():
+    for domain in LISTENER_DOMAINS:
+        for conf in CORE.config.get(domain, []):
+            if conf.get(CONF_PLATFORM) == "mk2pvrouter" and CONF_TAG_NAME in conf:
+                for listener in expand_indexes(conf):
+                    yield listener[CONF_TAG_NAME]
+
+
 async def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID])
     await cg.register_component(var, config)
     await uart.register_uart_device(var, config)
+    for conf in config.get(CONF_INPUTS, []):
+        router = cg.new_Pvariable(conf[CONF_ID])
+        await uart.register_uart_device(router, conf)
+        cg.add(var.add_input(router))
+    if CONF_BAUD_RATE in config:
+        cg.add(var.set_baud_rate(config[CONF_BAUD_RATE]))
+    cg.add(var.set_checksum_mode(config[CONF_CHECKSUM_MODE]))
+    cg.add(var.set_continuous(config[CONF_CONTINUOUS]))
+    cg.add(var.set_aggregate(config[CONF_AGGREGATE]))
+    cg.add(var.set_publish_on_change(config[CONF_PUBLISH_ON_CHANGE]))
+    cg.add(var.set_max_bytes_per_loop(config[CONF_MAX_BYTES_PER_LOOP]))
+    if CONF_MAX_TIME_PER_LOOP in config:
+        cg.add(var.set_max_loop_time(config[CONF_MAX_TIME_PER_LOOP]))
+    cg.add(var.set_adaptive_budget(config[CONF_ADAPTIVE_BUDGET]))
+    cg.add(var.set_verify_all_crc(config[CONF_VERIFY_ALL_CRC]))
+    if CONF_MAX_PUBLISH_PER_LOOP in config:
+        cg.add(var.set_max_publish_per_loop(config[CONF_MAX_PUBLISH_PER_LOOP]))
+    if CONF_STALE_TIMEOUT in config:
+        cg.add(var.set_stale_timeout(config[CONF_STALE_TIMEOUT]))
+    # Profiling scopes are compiled in the parser too, and compiled out without this flag
+    if CONF_PROFILE in config:
+        cg.add_build_flag("-DMK2PVROUTER_PROFILE")
+        cg.add(var.set_profile_interval(config[CONF_PROFILE]))
+    # Buffers fit the longest listened or forwarded tag and the longest value, NUL included
+    tags = list(_listened_tags())
+    if CONF_STREAM in config:
+        tags.extend(config[CONF_STREAM].get(CONF_TAGS, []))
+    tag_size = max((len(tag) for tag in tags), default=1) + 1
+    if CONF_STREAM in config and CONF_TAGS not in config[CONF_STREAM]:
+        # Any tag may be forwarded, keep the default size of the parser
+        tag_size = max(tag_size, 16)
+    cg.add_build_flag(f"-DMK2PVROUTER_MAX_TAG_SIZE={min(tag_size, 255)}")
+    cg.add_build_flag(f"-DMK2PVROUTER_MAX_VAL_SIZE={config[CONF_MAX_VALUE_LENGTH] + 1}")
+    if config.get(CONF_READER_TASK, False):
+        cg.add(var.set_reader_task(True))
+    if CONF_BINARY in config:
+        conf = config[CONF_BINARY]
+        cg.add_build_flag(f"-DMK2PVROUTER_MAX_BINARY_GROUPS={conf[CONF_MAX_GROUPS]}")
+        for tag in conf[CONF_TAGS]:
+            cg.add(var.add_binary_tag(tag[CONF_TAG_ID], tag[CONF_TAG_NAME]))
+    if CONF_STREAM in config:
+        conf = config[CONF_STREAM]
+        stream = cg.new_Pvariable(conf[CONF_ID])
+        cg.add(stream.set_protocol(conf[CONF_PROTOCOL]))
+        cg.add(stream.set_address(str(conf[CONF_ADDRESS]), conf[CONF_PORT]))
+        cg.add(stream.set_mtu(conf[CONF_MTU]))
+        cg.add(stream.set_flush_interval(conf[CONF_FLUSH_INTERVAL]))
+        for tag in conf.get(CONF_TAGS, []):
+            cg.add(stream.add_tag(tag))
+        cg.add(var.set_stream(stream))
+        cg.add_define("USE_MK2PVROUTER_STREAM")
+    # Slots of the snapshot values are found with find_snapshot_slot(), once in each lambda
+    for conf in config.get(CONF_ON_FRAME, []):
+        trigger = cg.new_Pvariable(conf[CONF_TRIGGER_ID], var)
+        await automation.build_automation(trigger, [(FrameSnapshotConstRef, "x")], conf)
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "esphome/core/automation.h"
+#include "mk2pvrouter.h"
+
+namespace esphome {
+namespace mk2pvrouter {
+
+/**
+ * @class FrameTrigger
+ * @brief Triggers the on_frame automations with the snapshot of each complete frame.
+ */
+class FrameTrigger : public Trigger<const FrameSnapshot &> {
+ public:
+  explicit FrameTrigger(Mk2PVRouter *parent) {
+    parent->add_on_frame_callback([this](const FrameSnapshot &snapshot) { this->trigger(snapshot); });
+  }
+};
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
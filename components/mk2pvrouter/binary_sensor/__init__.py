@@ -1,21 +1,115 @@
 import esphome.codegen as cg
 from esphome.components import binary_sensor
-from esphome.const import CONF_ID
+import esphome.config_validation as cv
+import esphome.final_validate as fv
+from esphome.const import CONF_ID, CONF_TYPE, DEVICE_CLASS_CONNECTIVITY, ENTITY_CATEGORY_DIAGNOSTIC
 
-from .. import CONF_TAG_NAME, CONF_MK2PVROUTER_ID, MK2PVROUTER_LISTENER_SCHEMA, mk2pvrouter_ns
+from .. import (
+    CONF_MK2PVROUTER_ID,
+    CONF_ROUTER_ID,
+    CONF_STALE_TIMEOUT,
+    CONF_TAG_NAME,
+    MK2PVROUTER_LISTENER_SCHEMA,
+    Mk2PVRouter,
+    Mk2PVRouterInput,
+    expand_indexes,
+    indexed_listener_schema,
+    mk2pvrouter_ns,
+    register_mk2pvrouter_listener,
+    validate_indexes,
+)
 
 Mk2PVRouterBinarySensor = mk2pvrouter_ns.class_(
     "Mk2PVRouterBinarySensor", binary_sensor.BinarySensor, cg.Component
 )
 
-CONFIG_SCHEMA = binary_sensor.binary_sensor_schema(Mk2PVRouterBinarySensor).extend(
-    MK2PVROUTER_LISTENER_SCHEMA
+CONF_ON_VALUE = "on_value"
+CONF_OFF_VALUE = "off_value"
+CONF_BITMASK = "bitmask"
+
+TYPE_TAG = "tag"
+TYPE_LINK = "link"
+
+
+def validate_mapping(config):
+    if CONF_BITMASK in config and (CONF_ON_VALUE in config or CONF_OFF_VALUE in config):
+        raise cv.Invalid(f"{CONF_BITMASK} cannot be used with {CONF_ON_VALUE} or {CONF_OFF_VALUE}")
+    if config.get(CONF_ON_VALUE) is not None and config.get(CONF_ON_VALUE) == config.get(CONF_OFF_VALUE):
+        raise cv.Invalid(f"{CONF_ON_VALUE} and {CONF_OFF_VALUE} must differ")
+    return config
+
+
+TAG_SCHEMA = indexed_listener_schema(
+    cv.All(
+        binary_sensor.binary_sensor_schema(Mk2PVRouterBinarySensor)
+        .extend(MK2PVROUTER_LISTENER_SCHEMA)
+        .extend(
+            {
+                cv.Optional(CONF_ON_VALUE): cv.All(cv.string, cv.Length(min=1)),
+                cv.Optional(CONF_OFF_VALUE): cv.All(cv.string, cv.Length(min=1)),
+                cv.Optional(CONF_BITMASK): cv.All(cv.hex_uint32_t, cv.Range(min=1)),
+            }
+        ),
+        validate_mapping,
+        validate_indexes,
+    )
+)
+
+# On while complete frames keep coming from the router, within the stale timeout of the hub
+LINK_SCHEMA = binary_sensor.binary_sensor_schema(
+    device_class=DEVICE_CLASS_CONNECTIVITY,
+    entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+).extend(
+    {
+        cv.GenerateID(CONF_MK2PVROUTER_ID): cv.use_id(Mk2PVRouter),
+        cv.Optional(CONF_ROUTER_ID): cv.use_id(Mk2PVRouterInput),
+    }
 )
 
+CONFIG_SCHEMA = cv.typed_schema(
+    {
+        TYPE_TAG: TAG_SCHEMA,
+        TYPE_LINK: LINK_SCHEMA,
+    },
+    lower=True,
+    default_type=TYPE_TAG,
+)
+
+
+def _final_validate(config):
+    # Without stale timeout, the lines are never checked, so a link sensor would never turn off
+    if config[CONF_TYPE] != TYPE_LINK:
+        return config
+    full_config = fv.full_config.get()
+    hub_path = full_config.get_path_for_id(config[CONF_MK2PVROUTER_ID])[:-1]
+    if CONF_STALE_TIMEOUT not in full_config.get_config_for_path(hub_path):
+        raise cv.Invalid(f"A {TYPE_LINK} binary sensor requires the {CONF_STALE_TIMEOUT} of its hub")
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
 
 async def to_code(config):
+    if config[CONF_TYPE] == TYPE_LINK:
+        mk2pvrouter = await cg.get_variable(config[CONF_MK2PVROUTER_ID])
+        sens = await binary_sensor.new_binary_sensor(config)
+        router = await cg.get_variable(config[CONF_ROUTER_ID]) if CONF_ROUTER_ID in config else cg.nullptr
+        cg.add(mk2pvrouter.set_link_sensor(sens, router))
+        return
+
+    for conf in expand_indexes(config):
+        await _register_tag_sensor(conf)
+
+
+async def _register_tag_sensor(config):
     var = cg.new_Pvariable(config[CONF_ID], config[CONF_TAG_NAME])
     await cg.register_component(var, config)
     await binary_sensor.register_binary_sensor(var, config)
-    mk2pvrouter = await cg.get_variable(config[CONF_MK2PVROUTER_ID])
-    cg.add(mk2pvrouter.register_mk2pvrouter_listener(var))
\ No newline at end of file
+    await register_mk2pvrouter_listener(var, config)
+    if CONF_ON_VALUE in config:
+        cg.add(var.set_on_value(config[CONF_ON_VALUE]))
+    if CONF_OFF_VALUE in config:
+        cg.add(var.set_off_value(config[CONF_OFF_VALUE]))
+    if CONF_BITMASK in config:
+        cg.add(var.set_bitmask(config[CONF_BITMASK]))
@@ -1,14 +1,110 @@
 #include "esphome/core/log.h"
 #include "mk2pvrouter_binary_sensor.h"
+
+#include <cinttypes>
+#include <cstring>
+
 namespace esphome {
 namespace mk2pvrouter {
 static const char *const TAG = "mk2pvrouter_binary_sensor";
+
+/**
+ * @brief Decodes an unsigned decimal integer, wrapping around above 32 bits.
+ *
+ * @return false If the value is empty or has a character other than a digit.
+ */
+static bool decode_integer(const char *val, size_t len, uint32_t *out) {
+  uint32_t acc = 0;
+
+  if (!len)
+    return false;
+  for (size_t i = 0; i < len; i++) {
+    const uint8_t digit = val[i] - '0';
+    if (digit >= 10)
+      return false;
+    acc = acc * 10 + digit;
+  }
+  *out = acc;
+  return true;
+}
+
 Mk2PVRouterBinarySensor::Mk2PVRouterBinarySensor(const char *tag) { this->tag = std::string(tag); }
-void Mk2PVRouterBinarySensor::publish_val(const std::string &val) {
-  // Convert the string value to a boolean (e.g., "1" -> true, "0" -> false)
-  bool state = (val != "0");
+void Mk2PVRouterBinarySensor::set_on_value(const char *on_value) {
+  on_value_ = on_value;
+  on_len_ = strlen(on_value);
+}
+void Mk2PVRouterBinarySensor::set_off_value(const char *off_value) {
+  off_value_ = off_value;
+  off_len_ = strlen(off_value);
+}
+void Mk2PVRouterBinarySensor::publish_val(const std::string &val) { publish_raw(val.c_str(), val.size()); }
+
+/**
+ * @brief Maps a raw value to a state.
+ *
+ * @details With a bitmask, the state is on when the value has one of its bits set. Otherwise a value
+ * equal to on_value is on, and one equal to off_value is off. The other values are off when only
+ * on_value is set, on when only off_value is set, and ignored when both are. Without any mapping,
+ * every value but "0" is on.
+ *
+ * @return false If the value does not map to a state.
+ */
+bool Mk2PVRouterBinarySensor::decode_state_(const char *val, size_t len, bool *state) const {
+  if (bitmask_) {
+    uint32_t number;
+    if (!decode_integer(val, len, &number))
+      return false;
+    *state = number & bitmask_;
+    return true;
+  }
+  if (on_value_ != nullptr && len == on_len_ && !memcmp(val, on_value_, len)) {
+    *state = true;
+    return true;
+  }
+  if (off_value_ != nullptr && len == off_len_ && !memcmp(val, off_value_, len)) {
+    *state = false;
+    return true;
+  }
+  if (on_value_ != nullptr && off_value_ != nullptr)
+    return false;
+  if (on_value_ != nullptr || off_value_ != nullptr)
+    *state = on_value_ == nullptr;
+  else
+    *state = !(len == 1 && val[0] == '0');
+  return true;
+}
+
+/**
+ * @brief Publishes the state of a raw value, only when it differs from the last one published.
+ */
+void Mk2PVRouterBinarySensor::publish_raw(const char *val, size_t len) {
+  bool state;
+
+  if (!decode_state_(val, len, &state)) {
+    ESP_LOGV(TAG, "Value '%s' of tag %s is neither on nor off", val, this->tag.c_str());
+    return;
+  }
+  /* Relays and diverter states rarely switch, skip the filters of the sensor in between */
+  if (published_ && state == last_state_)
+    return;
+  published_ = true;
+  last_state_ = state;
   publish_state(state);
 }
-void Mk2PVRouterBinarySensor::dump_config() { LOG_BINARY_SENSOR("  ", "Mk2PVRouter Binary Sensor", this); }
+
+/**
+ * @brief The last state is kept, but the next one is published even if unchanged.
+ */
+void Mk2PVRouterBinarySensor::publish_stale() { published_ = false; }
+
+void Mk2PVRouterBinarySensor::dump_config() {
+  LOG_BINARY_SENSOR("  ", "Mk2PVRouter Binary Sensor", this);
+  if (bitmask_)
+    ESP_LOGCONFIG(TAG, "    Bitmask: 0x%08" PRIX32, bitmask_);
+  if (on_value_ != nullptr)
+    ESP_LOGCONFIG(TAG, "    On value: %s", on_value_);
+  if (off_value_ != nullptr)
+    ESP_LOGCONFIG(TAG, "    Off value: %s", off_value_);
+}
 }  // namespace mk2pvrouter
-}  // namespace esphome
\ No newline at end of file
+}  // namespace esphome
@@ -9,8 +9,27 @@ class Mk2PVRouterBinarySensor : public Mk2PVRouterListener, public binary_sensor
  public:
   explicit Mk2PVRouterBinarySensor(const char *tag);
   void publish_val(const std::string &val) override;
+  void publish_raw(const char *val, size_t len) override;
+  void publish_stale() override;
   void dump_config() override;
+  void set_on_value(const char *on_value);
+  void set_off_value(const char *off_value);
+  void set_bitmask(uint32_t bitmask) { bitmask_ = bitmask; }
+
+ protected:
+  /* Values mapped to on and off, compared with the raw value (nullptr when not set) */
+  const char *on_value_{nullptr};
+  size_t on_len_{0};
+  const char *off_value_{nullptr};
+  size_t off_len_{0};
+  /* On when the value, as an integer, has one of these bits set (0 when not set) */
+  uint32_t bitmask_{0};
+  /* Last state published, to only publish the transitions */
+  bool published_{false};
+  bool last_state_{false};
+
+  bool decode_state_(const char *val, size_t len, bool *state) const;
 };
 
 }  // namespace mk2pvrouter
-}  // namespace esphome
\ No newline at end of file
+}  // namespace esphome
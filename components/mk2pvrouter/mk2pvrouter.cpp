@@ -1,224 +1,981 @@
 #include "mk2pvrouter.h"
+#include "esphome/core/hal.h"
+#include "esphome/core/helpers.h"
 #include "esphome/core/log.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+
 namespace esphome {
 namespace mk2pvrouter {
 
 static const char *const TAG = "mk2pvrouter";
 
-constexpr uint8_t START_FRAME = 0x2;
-constexpr uint8_t END_FRAME = 0x3;
-constexpr uint8_t LINE_FEED = 0xa;
-constexpr uint8_t CARRIAGE_RETURN = 0xd;
-constexpr uint8_t TAB = 0x9;
-constexpr int MAX_ITERATIONS = 128;
+static const char *aggregate_to_string(Aggregate aggregate) {
+  switch (aggregate) {
+    case Aggregate::MEAN:
+      return "mean";
+    case Aggregate::MIN:
+      return "min";
+    case Aggregate::MAX:
+      return "max";
+    default:
+      return "last";
+  }
+}
+
+/* Bytes moved from the UART per read_array() call */
+constexpr size_t READ_CHUNK_SIZE = 32;
+/* The adaptive byte budget grows up to this many times the configured one */
+constexpr uint32_t MAX_ADAPTIVE_FACTOR = 8;
+/* Errors are logged at most once per interval (ms), the others are only counted */
+constexpr uint32_t ERROR_LOG_INTERVAL = 1000;
+#ifdef USE_ESP32
+/* Above the priority of the main loop task, so that a busy loop() does not delay the reader */
+constexpr UBaseType_t READER_TASK_PRIORITY = 5;
+constexpr uint32_t READER_TASK_STACK_SIZE = 2048;
+#endif
+
+void InputLine::on_frame_start() { hub->on_frame_start_(*this); }
+bool InputLine::accept_tag(const char *tag, size_t tag_len, uint32_t tag_hash) {
+  return hub->accept_tag_(*this, tag, tag_hash);
+}
+void InputLine::on_group(const char *tag, size_t tag_len, uint32_t tag_hash, const char *val, size_t val_len) {
+  hub->on_group_(*this, tag, tag_hash, val, val_len);
+}
+void InputLine::on_frame_end(bool complete) { hub->on_frame_end_(*this, complete); }
+void InputLine::on_error(ParseError error) { hub->on_error_(*this, error); }
 
 /**
- * @brief Extracts a field (substring) from a buffer, delimited by a TAB character (0x9).
+ * @brief Reads the available characters of every input line and feeds them to their frame parser.
  * 
- * @param dest Pointer to the destination buffer where the extracted field will be stored.
- * @param buf_start Pointer to the start of the buffer to extract the field from.
- * @param buf_end Pointer to the end of the buffer.
- * @param max_len Maximum length of the destination buffer.
- * @return int Length of the extracted field if successful, 0 if no TAB delimiter is found, 
- *             or the length of the field if it exceeds max_len (but the field is not copied).
+ * @param start Time when the loop() call started (us).
  */
-static int get_field(char *dest, char *buf_start, char *buf_end, int max_len) {
-  char *field_end;
-  int len;
+void Mk2PVRouter::read_chars_(uint32_t start) {
+  for (auto *line : lines_) {
+    if (!read_line_(*line, start))
+      break;
+  }
+}
+
+/**
+ * @brief Reads the available characters of an input line by chunks and feeds them to its frame parser.
+ * 
+ * @details Reading stops once the byte budget of the line is spent or, when configured, once the
+ * time budget of the loop() call is exceeded, to give the other components a chance to run. With
+ * the adaptive budget, the byte budget doubles while the UART backlog keeps growing between two
+ * calls, and goes back down towards the configured one once the backlog is drained.
+ * 
+ * @param line The input line.
+ * @param start Time when the loop() call started (us).
+ * @return false If the time budget is exceeded.
+ */
+bool Mk2PVRouter::read_line_(InputLine &line, uint32_t start) {
+  uint8_t chunk[READ_CHUNK_SIZE];
+  uint32_t budget = line.byte_budget;
+  bool in_time = true;
+  size_t len;
 
-  field_end = static_cast<char *>(memchr(buf_start, TAB, buf_end - buf_start));
-  if (!field_end)
+  while (!line.parser.is_idle() && budget &&
+         (len = read_input_(line, chunk, std::min<size_t>(budget, READ_CHUNK_SIZE)))) {
+    budget -= len;
+    if (timing_)
+      line.chunk_start = micros();
+    line.parser.feed(chunk, len);
+    if (timing_)
+      line.frame_time += micros() - line.chunk_start;
+    if (max_loop_time_ && micros() - start >= max_loop_time_) {
+      in_time = false;
+      break;
+    }
+  }
+
+  if (!adaptive_budget_)
+    return in_time;
+  const size_t avail = input_backlog_(line);
+  if (avail > line.last_available)
+    line.byte_budget = std::min(line.byte_budget * 2, max_bytes_per_loop_ * MAX_ADAPTIVE_FACTOR);
+  else if (!avail)
+    line.byte_budget = std::max(line.byte_budget / 2, max_bytes_per_loop_);
+  line.last_available = avail;
+  return in_time;
+}
+
+/**
+ * @brief Reads a chunk of the received characters of an input line, from the reader task ring when
+ * it runs, or from the UART.
+ * 
+ * @param line The input line.
+ * @param data Where to copy the characters.
+ * @param len Largest number of characters to read.
+ * @return size_t Number of characters read, 0 when none is available.
+ */
+size_t Mk2PVRouter::read_input_(InputLine &line, uint8_t *data, size_t len) {
+  MK2PVROUTER_PROFILE_SCOPE(ProfilePhase::READ);
+#ifdef USE_ESP32
+  if (line.ring != nullptr)
+    return line.ring->pop(data, len);
+#endif
+  const int avail = line.device->available();
+  if (avail <= 0)
     return 0;
-  len = field_end - buf_start;
-  if (len >= max_len)
-    return len;
-  strncpy(dest, buf_start, len);
-  dest[len] = '\0';
+  len = std::min<size_t>(avail, len);
+  return line.device->read_array(data, len) ? len : 0;
+}
 
-  return len;
+/**
+ * @brief Number of received characters of an input line waiting to be read by read_input_().
+ */
+size_t Mk2PVRouter::input_backlog_(InputLine &line) {
+#ifdef USE_ESP32
+  if (line.ring != nullptr)
+    return line.ring->size();
+#endif
+  const int avail = line.device->available();
+  return avail > 0 ? avail : 0;
 }
 
+#ifdef USE_ESP32
 /**
- * @brief Calculates the CRC (checksum) for a given group of characters.
+ * @brief Body of the reader task: moves the characters from the UARTs to the rings, forever.
  * 
- * @param grp Pointer to the start of the group.
- * @param grp_len Length of the group.
- * @return uint8_t The calculated CRC value.
+ * @details The UART component does not expose the driver event queue, so the task sleeps for a
+ * tick whenever every UART is empty. Characters that do not fit in a ring are counted as lost.
+ * 
+ * @param arg The Mk2PVRouter hub.
  */
-uint8_t Mk2PVRouter::calculate_crc_(const char *grp, int grp_len) {
-  uint8_t crc_tmp = 0;
-  for (int i = 0; i < grp_len - checksum_area_end_; i++) {
-    crc_tmp += grp[i];
+void Mk2PVRouter::reader_task_func_(void *arg) {
+  auto *hub = static_cast<Mk2PVRouter *>(arg);
+  uint8_t chunk[READ_CHUNK_SIZE];
+
+  for (;;) {
+    bool idle = true;
+    for (auto *line : hub->lines_) {
+      const int avail = line->device->available();
+      if (avail <= 0)
+        continue;
+      idle = false;
+      const size_t len = std::min<size_t>(avail, READ_CHUNK_SIZE);
+      if (!line->device->read_array(chunk, len))
+        continue;
+      const size_t pushed = line->ring->push(chunk, len);
+      if (pushed < len)
+        hub->lost_bytes_.fetch_add(len - pushed, std::memory_order_relaxed);
+    }
+    if (idle)
+      vTaskDelay(1);
   }
-  crc_tmp &= 0x3F;
-  crc_tmp += 0x20;
-  return crc_tmp;
 }
+#endif
 
 /**
- * @brief Verifies the CRC of a group by comparing the calculated CRC with the provided CRC.
- * 
- * @param grp Pointer to the start of the group.
- * @param grp_end Pointer to the end of the group.
- * @return true If the CRC matches.
- * @return false If there is a mismatch.
- * @note Logs an error message if the CRC does not match.
+ * @brief Handles the start frame (0x2) of an input line.
  */
-bool Mk2PVRouter::check_crc_(const char *grp, const char *grp_end) {
-  int grp_len = grp_end - grp;
-  const auto raw_crc = grp[grp_len - 1];
+void Mk2PVRouter::on_frame_start_(InputLine &line) {
+  /* Drop what a frame interrupted by a parser restart left, but keep the values of an incomplete frame */
+  if (!line.partial_frame)
+    line.batches[line.filling_batch].records.clear();
+  if (snapshots_) {
+    line.snapshot.values.resize(tag_count_);
+    for (auto &value : line.snapshot.values)
+      value.received = false;
+  }
+  if (timing_) {
+    line.frame_time = 0;
+    line.chunk_start = micros();
+  }
+#ifdef USE_MK2PVROUTER_STREAM
+  if (stream_ != nullptr)
+    stream_->begin_frame(line.index);
+#endif
+}
+
+/**
+ * @brief Only lets the parser handle the groups of the listened or forwarded tags, unless all CRC
+ * are verified.
+ */
+bool Mk2PVRouter::accept_tag_(InputLine &line, const char *tag, uint32_t tag_hash) {
+  line.accepted_entry = find_dispatch_entry_(line.index, tag, tag_hash);
+#ifdef USE_MK2PVROUTER_STREAM
+  if (line.accepted_entry == nullptr && stream_ != nullptr)
+    return stream_->selects(tag, tag_hash);
+#endif
+  return line.accepted_entry != nullptr;
+}
 
-  const auto calculated_crc = calculate_crc_(grp, grp_len);
+/**
+ * @brief Looks up the listeners of a valid group and stores its value for them, until the end of
+ * the frame, or the next update() in continuous mode.
+ */
+void Mk2PVRouter::on_group_(InputLine &line, const char *tag, uint32_t tag_hash, const char *val, size_t val_len) {
+  MK2PVROUTER_PROFILE_SCOPE(ProfilePhase::GROUP);
+  statistics_.groups_parsed++;
+#ifdef USE_MK2PVROUTER_STREAM
+  if (stream_ != nullptr)
+    stream_->add_group(line.index, tag, tag_hash, val, val_len, line.parser.get_received_crc());
+#endif
 
-  if (raw_crc != calculated_crc) {
-    ESP_LOGE(TAG, "CRC mismatch: expected %d, got %d", calculated_crc, raw_crc);
-    return false;
+  /* Already looked up by accept_tag() when the tag filter skips the unused groups */
+  const auto *entry =
+      line.parser.get_tag_filter() ? line.accepted_entry : find_dispatch_entry_(line.index, tag, tag_hash);
+  if (!entry)
+    return;
+  if (snapshots_)
+    snapshot_value_(line, *entry, val, val_len);
+
+  /* Values are aggregated from every frame, repeated ones included */
+  if (publish_on_change_ && !entry->aggregated && !value_changed_(*entry, val, val_len))
+    return;
+
+  if (continuous_)
+    publish_value_(*entry, val, val_len);
+  else
+    record_value_(line, *entry, val, val_len);
+}
+
+/**
+ * @brief Counts and logs a parse error of an input line.
+ */
+void Mk2PVRouter::on_error_(InputLine &line, ParseError error) {
+  switch (error) {
+    case ParseError::CRC_MISMATCH:
+      statistics_.crc_errors++;
+      if (error_log_allowed_())
+        ESP_LOGE(TAG, "CRC mismatch: expected %d, got %d", line.parser.get_calculated_crc(),
+                 line.parser.get_received_crc());
+      break;
+    case ParseError::INVALID_TAG:
+      statistics_.invalid_tags++;
+      if (error_log_allowed_())
+        ESP_LOGE(TAG, "Invalid tag.");
+      break;
+    case ParseError::INVALID_VALUE:
+      statistics_.invalid_values++;
+      if (error_log_allowed_())
+        ESP_LOGE(TAG, "Invalid value for tag %s", line.parser.get_tag());
+      break;
+    case ParseError::FIELD_OVERFLOW:
+      statistics_.overflows++;
+      break;
+    case ParseError::NO_GROUP:
+      if (error_log_allowed_())
+        ESP_LOGE(TAG, "No group found");
+      break;
+    case ParseError::NO_END_FRAME:
+      if (error_log_allowed_())
+        ESP_LOGE(TAG, "No end frame found");
+      break;
   }
-  return true;
 }
 
 /**
- * @brief Reads characters from the input buffer until a specific character is found or the buffer is full.
+ * @brief Handles the end frame (0x3) of an input line. Stays idle until the next update(), or waits
+ * for the next frame in continuous mode.
+ * 
+ * @details Outside of continuous mode, the batch of the frame is handed off to loop() and the other
+ * batch starts filling, so that publishing the frame never delays the reception of the next one.
+ * A batch still waiting to be published gets the values of the newer one merged in, so that no
+ * value filtered by publish_on_change against it is lost.
+ * The valid groups of an incomplete frame are kept, and the next frame is waited for right away
+ * instead of at the next update(): its values are merged in the same batch. When that frame is
+ * incomplete too, the batch is handed off anyway.
  * 
- * @param drop If true, discards characters until the target character is found.
- * @param c The target character to stop reading at.
- * @return true If the target character is found.
- * @return false If the buffer is full or the target character is not found.
- * @note Logs a warning if the internal buffer is full.
+ * @param complete false If the frame ended in the middle of a group, or was cut by a start frame.
  */
-bool Mk2PVRouter::read_chars_until_(bool drop, uint8_t c) {
-  uint8_t j = 0;
+void Mk2PVRouter::on_frame_end_(InputLine &line, bool complete) {
+  if (complete)
+    statistics_.frames_received++;
+  else
+    statistics_.dropped_frames++;
 
-  while (available() > 0 && j++ < 128) {
-    const auto received = read();
-    if (received == c)
-      return true;
-    if (drop)
-      continue;
-    /*
-     * Internal buffer is full, switch to OFF mode.
-     * Data will be retrieved on next update.
-     */
-    if (buf_index_ >= (MAX_BUF_SIZE - 1)) {
-      ESP_LOGW(TAG, "Internal buffer full");
-      state_ = State::OFF;
-      return false;
+  if (timing_) {
+    const uint32_t now = micros();
+    const uint32_t frame_time = line.frame_time + (now - line.chunk_start);
+    frame_time_min_ = std::min(frame_time_min_, frame_time);
+    frame_time_max_ = std::max(frame_time_max_, frame_time);
+    frame_time_total_ += frame_time;
+    frame_time_count_++;
+    /* The remaining chars of the chunk are not part of the frame */
+    line.frame_time = 0;
+    line.chunk_start = now;
+  }
+
+#ifdef USE_MK2PVROUTER_STREAM
+  if (stream_ != nullptr)
+    stream_->end_frame(line.index, complete);
+#endif
+  if (complete) {
+    line.last_frame = millis();
+    if (line.stale)
+      set_line_stale_(line, false);
+  }
+  if (complete && snapshots_) {
+    line.snapshot.line = line.index;
+    line.snapshot.timestamp = millis();
+    frame_callback_.call(line.snapshot);
+  }
+
+  if (!continuous_ && !complete && !line.partial_frame) {
+    line.partial_frame = true;
+  } else if (!continuous_) {
+    line.partial_frame = false;
+    auto &waiting = line.batches[line.filling_batch ^ 1];
+    auto &filling = line.batches[line.filling_batch];
+    if (waiting.ready) {
+      statistics_.skipped_frames++;
+      merge_batch_(waiting, filling);
+    } else {
+      filling.ready = true;
+      filling.published = 0;
+      line.filling_batch ^= 1;
     }
-    buf_[buf_index_++] = received;
+    line.batches[line.filling_batch].records.clear();
+  }
+
+  if (continuous_ || !complete)
+    line.parser.start();
+}
+
+/**
+ * @brief Tells whether an error can be logged, to not flood a slow serial logger.
+ * 
+ * @return true At most once per ERROR_LOG_INTERVAL, after reporting how many errors were not logged.
+ */
+bool Mk2PVRouter::error_log_allowed_() {
+  const uint32_t now = millis();
+
+  if (last_error_log_ && now - last_error_log_ < ERROR_LOG_INTERVAL) {
+    suppressed_errors_++;
+    return false;
   }
+  if (suppressed_errors_)
+    ESP_LOGW(TAG, "%" PRIu32 " errors not logged", suppressed_errors_);
+  suppressed_errors_ = 0;
+  /* 0 means never logged */
+  last_error_log_ = now ? now : 1;
+  return true;
+}
 
-  return false;
+/**
+ * @brief Publishes the statistics to the diagnostic sensors, and starts a new frame time window.
+ */
+void Mk2PVRouter::publish_statistics_() {
+#ifdef USE_SENSOR
+  if (frames_received_sensor_ != nullptr)
+    frames_received_sensor_->publish_state(statistics_.frames_received);
+  if (groups_parsed_sensor_ != nullptr)
+    groups_parsed_sensor_->publish_state(statistics_.groups_parsed);
+  if (crc_errors_sensor_ != nullptr)
+    crc_errors_sensor_->publish_state(statistics_.crc_errors);
+  if (invalid_tags_sensor_ != nullptr)
+    invalid_tags_sensor_->publish_state(statistics_.invalid_tags);
+  if (invalid_values_sensor_ != nullptr)
+    invalid_values_sensor_->publish_state(statistics_.invalid_values);
+  if (overflows_sensor_ != nullptr)
+    overflows_sensor_->publish_state(statistics_.overflows);
+  if (dropped_frames_sensor_ != nullptr)
+    dropped_frames_sensor_->publish_state(statistics_.dropped_frames);
+  if (skipped_frames_sensor_ != nullptr)
+    skipped_frames_sensor_->publish_state(statistics_.skipped_frames);
+  if (lost_bytes_sensor_ != nullptr)
+    lost_bytes_sensor_->publish_state(statistics_.lost_bytes);
+  if (frame_time_count_) {
+    if (frame_time_min_sensor_ != nullptr)
+      frame_time_min_sensor_->publish_state(frame_time_min_);
+    if (frame_time_mean_sensor_ != nullptr)
+      frame_time_mean_sensor_->publish_state(static_cast<float>(frame_time_total_) / frame_time_count_);
+    if (frame_time_max_sensor_ != nullptr)
+      frame_time_max_sensor_->publish_state(frame_time_max_);
+  }
+#endif
+  frame_time_min_ = UINT32_MAX;
+  frame_time_max_ = 0;
+  frame_time_total_ = 0;
+  frame_time_count_ = 0;
 }
 
 /**
- * @brief Initializes the Mk2PVRouter by setting the initial state to OFF.
+ * @brief Initializes the Mk2PVRouter by setting the initial state to OFF, or ON in continuous mode.
+ * 
+ * @details On ESP32, the reader task is started when configured, and pinned to the core that does
+ * not run the main loop when there are two. It serves every input line.
  */
-void Mk2PVRouter::setup() { state_ = State::OFF; }
+void Mk2PVRouter::setup() {
+  build_dispatch_table_();
+  init_pending_values_();
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  for (size_t i = 0; i < binary_tags_.size(); i++)
+    binary_tags_[i].tag = binary_names_[i].c_str();
+  std::sort(binary_tags_.begin(), binary_tags_.end(),
+            [](const BinaryTag &a, const BinaryTag &b) { return a.id < b.id; });
+#endif
+#ifdef USE_MK2PVROUTER_STREAM
+  if (stream_ != nullptr)
+    stream_->setup(lines_.size());
+#endif
+  for (auto *line : lines_) {
+    line->byte_budget = max_bytes_per_loop_;
+    /* Not linked until the first complete frame */
+    line->last_frame = millis();
+    line->stale = true;
+#ifdef USE_BINARY_SENSOR
+    if (line->link_sensor != nullptr)
+      line->link_sensor->publish_initial_state(false);
+#endif
+    line->parser.set_checksum_mode(checksum_mode_);
+    line->parser.set_tag_filter(!verify_all_crc_);
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+    line->parser.set_binary_tags(binary_tags_.data(), binary_tags_.size());
+#endif
+#ifdef USE_MK2PVROUTER_STREAM
+    if (stream_ != nullptr && stream_->forwards_all())
+      line->parser.set_tag_filter(false);
+#endif
+    if (continuous_) {
+      line->parser.start();
+      continue;
+    }
+    for (auto &batch : line->batches) {
+      /* The table is at least twice as large as the number of listened tags */
+      batch.records.reserve(dispatch_table_.size() / 2);
+      batch.published = 0;
+      batch.ready = false;
+    }
+    line->filling_batch = 0;
+    line->parser.stop();
+  }
+
+#ifdef USE_ESP32
+  if (reader_task_ && !reader_running_) {
+    for (auto *line : lines_)
+      line->ring = new SpscRing<READ_RING_SIZE>();  // NOLINT(cppcoreguidelines-owning-memory)
+#if portNUM_PROCESSORS > 1
+    const BaseType_t core = 1 - xPortGetCoreID();
+#else
+    const BaseType_t core = 0;
+#endif
+    if (xTaskCreatePinnedToCore(reader_task_func_, "mk2pvrouter", READER_TASK_STACK_SIZE, this, READER_TASK_PRIORITY,
+                                &reader_handle_, core) == pdPASS) {
+      reader_running_ = true;
+    } else {
+      ESP_LOGE(TAG, "Could not start the reader task, reading from loop()");
+      for (auto *line : lines_) {
+        delete line->ring;  // NOLINT(cppcoreguidelines-owning-memory)
+        line->ring = nullptr;
+      }
+    }
+  }
+#endif
+}
 
 /**
- * @brief Updates the Mk2PVRouter state. Resets the buffer index and transitions the state from OFF to ON.
+ * @brief Updates the Mk2PVRouter state. Transitions the state from OFF to ON, or publishes the values
+ * received since the last update in continuous mode.
  */
 void Mk2PVRouter::update() {
-  if (state_ == State::OFF) {
-    buf_index_ = 0;
-    state_ = State::ON;
+  publish_statistics_();
+  if (continuous_) {
+    publish_pending_values_();
+    return;
+  }
+  for (auto *line : lines_) {
+    if (line->parser.is_idle())
+      line->parser.start();
   }
 }
 
 /**
- * @brief Implements the main state machine for processing incoming data.
+ * @brief Implements the main loop, feeding the received characters of each input line to its frame
+ * parser, then publishing their last complete frame, if any, and the listeners whose update
+ * interval elapsed.
  * 
  * @details The state machine transitions through the following states:
  * - OFF: Does nothing.
- * - ON: Reads characters until the start frame (0x2) is found.
- * - START_FRAME_RECEIVED: Reads characters until the end frame (0x3) is found.
- * - END_FRAME_RECEIVED: Processes the buffer to extract groups, validate CRC, and publish values.
+ * - ON: Drops characters until the start frame (0x2) is found.
+ * - START_FRAME_RECEIVED: Waits for a group (0xa) or the end frame (0x3), which switches back to OFF.
+ * - START_GROUP_RECEIVED: Splits the group into its fields until the end of group (0xd), then
+ *   validates its CRC and publishes its value.
  */
 void Mk2PVRouter::loop() {
-  switch (state_) {
-    case State::OFF:
-      break;
-    case State::ON:
-      /* Dequeue chars until start frame (0x2) */
-      if (read_chars_until_(true, START_FRAME))
-        state_ = State::START_FRAME_RECEIVED;
-      break;
-    case State::START_FRAME_RECEIVED:
-      /* Dequeue chars until end frame (0x3) */
-      if (read_chars_until_(false, END_FRAME))
-        state_ = State::END_FRAME_RECEIVED;
-      break;
-    case State::END_FRAME_RECEIVED:
-      char *buf_finger;
-      char *grp_end;
-      char *buf_end;
-      int field_len;
-
-      buf_finger = buf_;
-      buf_end = buf_ + buf_index_;
-
-      /* Each frame is composed of multiple groups starting by 0xa(Line Feed) and ending by
-       * 0xd ('\r').
-       *
-       * Each group contains tag, data and a CRC separated by 0x9 (\t)
-       * 0xa | Tag | 0x9 | Data | 0x9 | CRC | 0xd
-       *     ^^^^^^^^^^^^^^^^^^^^^^^^^
-       * Checksum is computed on the above in standard mode.
-       *
-       */
-      while ((buf_finger = static_cast<char *>(memchr(buf_finger, LINE_FEED, buf_index_ - 1))) &&
-             ((buf_finger - buf_) < buf_index_)) {  // NOLINT(clang-diagnostic-sign-compare)
-        /* Point to the first char of the group after 0xa */
-        ++buf_finger;
-
-        /* Group len */
-        grp_end = static_cast<char *>(memchr(buf_finger, CARRIAGE_RETURN, buf_end - buf_finger));
-        if (!grp_end) {
-          ESP_LOGE(TAG, "No group found");
-          break;
-        }
+  const uint32_t start = max_loop_time_ ? micros() : 0;
 
-        if (!check_crc_(buf_finger, grp_end))
-          continue;
+#ifdef USE_ESP32
+  if (reader_running_) {
+    statistics_.lost_bytes += lost_bytes_.exchange(0, std::memory_order_relaxed);
+    /* Like the UART, a ring is not read while its parser is idle, but only fresh bytes are kept */
+    for (auto *line : lines_) {
+      if (line->parser.is_idle())
+        line->ring->discard();
+    }
+  }
+#endif
+  read_chars_(start);
+#ifdef USE_MK2PVROUTER_STREAM
+  if (stream_ != nullptr)
+    stream_->loop();
+#endif
+  for (auto *line : lines_)
+    publish_batch_(*line, start);
+  if (!timed_listeners_.empty())
+    publish_timed_values_();
+  if (stale_timeout_)
+    check_stale_lines_();
+#ifdef MK2PVROUTER_PROFILE
+  if (profile_interval_ && millis() - last_profile_ >= profile_interval_)
+    log_profile_();
+#endif
+}
 
-        /* Get tag */
-        field_len = get_field(tag_, buf_finger, grp_end, MAX_TAG_SIZE);
-        if (!field_len || field_len >= MAX_TAG_SIZE) {
-          ESP_LOGE(TAG, "Invalid tag.");
-          continue;
-        }
+/**
+ * @brief Marks the lines without complete frame for the stale timeout as stale. A line that never
+ * received one is stale from the start.
+ */
+void Mk2PVRouter::check_stale_lines_() {
+  const uint32_t now = millis();
 
-        /* Advance buf_finger to after the tag and the separator. */
-        buf_finger += field_len + 1;
+  for (auto *line : lines_) {
+    if (!line->stale && now - line->last_frame >= stale_timeout_)
+      set_line_stale_(*line, true);
+  }
+}
 
-        field_len = get_field(val_, buf_finger, grp_end, MAX_VAL_SIZE);
-        if (!field_len || field_len >= MAX_VAL_SIZE) {
-          ESP_LOGE(TAG, "Invalid value for tag %s", tag_);
-          continue;
-        }
+/**
+ * @brief Reports that the link of a line is lost, or back.
+ * 
+ * @details When the link is lost, the listeners of the line are told that their values are stale,
+ * and the values waiting to be published or compared are dropped, so that the first values received
+ * once the link is back are all published. The frame in progress is dropped, and the parser waits
+ * for the next start frame right away, instead of at the next update().
+ * 
+ * @param line The input line.
+ * @param stale true When no complete frame was received for the stale timeout.
+ */
+void Mk2PVRouter::set_line_stale_(InputLine &line, bool stale) {
+  line.stale = stale;
+#ifdef USE_BINARY_SENSOR
+  if (line.link_sensor != nullptr)
+    line.link_sensor->publish_state(!stale);
+#endif
+  if (!stale)
+    return;
+  ESP_LOGW(TAG, "No frame received on input %u for %" PRIu32 "ms, values are stale", line.index, stale_timeout_);
+
+  for (const auto &entry : dispatch_table_) {
+    if (!entry.count || entry.line != line.index)
+      continue;
+    if (!last_values_.empty())
+      last_values_[entry.tag_index].len = 0;
+    for (size_t j = entry.first; j < entry.first + entry.count; j++) {
+      const auto i = dispatch_listeners_[j];
+      if (!pending_values_.empty()) {
+        pending_values_[i].pending = false;
+        pending_values_[i].count = 0;
+      }
+      mk2pvrouter_listeners_[i]->publish_stale();
+    }
+  }
+  for (auto &batch : line.batches) {
+    batch.records.clear();
+    batch.ready = false;
+  }
+  line.partial_frame = false;
+  line.parser.start();
+}
+
+/**
+ * @brief Spreads the entries of a same tag listened on several input lines across the table.
+ */
+static inline uint32_t dispatch_hash(uint8_t line, uint32_t tag_hash) { return tag_hash ^ (line * 0x9E3779B1UL); }
+
+/**
+ * @brief Finds the input line a listener listens to.
+ * 
+ * @return int Index of the line, or -1 if the input of the listener is not one of this hub.
+ */
+int Mk2PVRouter::find_line_(const Mk2PVRouterListener *listener) const {
+  if (listener->get_input() == nullptr)
+    return 0;
+  for (size_t i = 1; i < lines_.size(); i++) {
+    if (lines_[i]->device == listener->get_input())
+      return i;
+  }
+  return -1;
+}
+
+/**
+ * @brief Builds the tag dispatch table from the registered listeners.
+ * 
+ * @details Listener indexes are grouped by input line and tag in dispatch_listeners_, and each
+ * (line, tag) gets an entry in an open addressing table indexed by their hash. The table is kept
+ * at most half full, so that most lookups, including the ones for tags nobody listens to, only
+ * probe a single entry.
+ */
+void Mk2PVRouter::build_dispatch_table_() {
+  std::vector<uint32_t> hashes;
+  std::vector<uint8_t> lines;
+  size_t tag_count = 0;
+
+  dispatch_listeners_.clear();
+  for (size_t i = 0; i < mk2pvrouter_listeners_.size(); i++) {
+    const auto &tag = mk2pvrouter_listeners_[i]->tag;
+    const int line = find_line_(mk2pvrouter_listeners_[i]);
+    hashes.push_back(hash_tag(tag.c_str(), tag.size()));
+    lines.push_back(line < 0 ? 0 : line);
+    if (line < 0) {
+      ESP_LOGE(TAG, "The input of the listener of tag %s is not one of this hub", tag.c_str());
+      continue;
+    }
+    dispatch_listeners_.push_back(i);
+  }
+  const auto same_key = [this, &lines](uint16_t a, uint16_t b) {
+    return lines[a] == lines[b] && mk2pvrouter_listeners_[a]->tag == mk2pvrouter_listeners_[b]->tag;
+  };
+  /* Group the listeners of a same line and tag, keeping their registration order */
+  std::stable_sort(dispatch_listeners_.begin(), dispatch_listeners_.end(), [this, &lines](uint16_t a, uint16_t b) {
+    if (lines[a] != lines[b])
+      return lines[a] < lines[b];
+    return mk2pvrouter_listeners_[a]->tag < mk2pvrouter_listeners_[b]->tag;
+  });
+  for (size_t i = 0; i < dispatch_listeners_.size(); i++) {
+    if (!i || !same_key(dispatch_listeners_[i], dispatch_listeners_[i - 1]))
+      tag_count++;
+  }
 
-        /* Advance buf_finger to end of group */
-        buf_finger += field_len + 1 + 1 + 1;
+  size_t size = 1;
+  while (size < 2 * tag_count)
+    size <<= 1;
+  dispatch_table_.assign(size, DispatchEntry{0, 0, 0, 0, 0, false});
+  last_values_.assign(publish_on_change_ ? tag_count : 0, LastValue{});
+  tag_count_ = tag_count;
+  tag_count = 0;
 
-        publish_value_(std::string(tag_), std::string(val_));
+  for (size_t i = 0; i < dispatch_listeners_.size();) {
+    const auto first = dispatch_listeners_[i];
+    size_t count = 1;
+    while (i + count < dispatch_listeners_.size() && same_key(dispatch_listeners_[i + count], first))
+      count++;
+    bool aggregated = false;
+    for (size_t j = i; j < i + count; j++) {
+      const auto index = dispatch_listeners_[j];
+      aggregated |= mk2pvrouter_listeners_[index]->needs_every_value() ||
+                    (stores_values_(index) &&
+                     mk2pvrouter_listeners_[index]->get_aggregate().value_or(aggregate_) != Aggregate::LAST);
+    }
+
+    size_t slot = dispatch_hash(lines[first], hashes[first]) & (size - 1);
+    while (dispatch_table_[slot].count)
+      slot = (slot + 1) & (size - 1);
+    dispatch_table_[slot] = DispatchEntry{hashes[first], static_cast<uint16_t>(i), static_cast<uint16_t>(count),
+                                          static_cast<uint16_t>(tag_count++), lines[first], aggregated};
+    i += count;
+  }
+}
+
+/**
+ * @brief Looks up the dispatch table entry of a tag of an input line.
+ * 
+ * @param line Index of the input line.
+ * @param tag The tag, NUL terminated.
+ * @param hash The hash of the tag.
+ * @return const DispatchEntry* The entry of the tag, or nullptr if no listener is registered for it.
+ */
+const DispatchEntry *Mk2PVRouter::find_dispatch_entry_(uint8_t line, const char *tag, uint32_t hash) const {
+  const size_t mask = dispatch_table_.size() - 1;
+
+  if (dispatch_table_.empty())
+    return nullptr;
+  for (size_t slot = dispatch_hash(line, hash) & mask;; slot = (slot + 1) & mask) {
+    const auto &entry = dispatch_table_[slot];
+    if (!entry.count)
+      return nullptr;
+    if (entry.hash == hash && entry.line == line &&
+        mk2pvrouter_listeners_[dispatch_listeners_[entry.first]]->tag == tag)
+      return &entry;
+  }
+}
+
+/**
+ * @brief Compares a value with the last one received for its tag, and keeps it as the last one.
+ * 
+ * @param entry The dispatch table entry of the tag associated with the value.
+ * @param val The value, NUL terminated.
+ * @param len Length of the value.
+ * @return true If the value differs from the last one, or is the first one received.
+ */
+bool Mk2PVRouter::value_changed_(const DispatchEntry &entry, const char *val, size_t len) {
+  auto &last = last_values_[entry.tag_index];
+
+  if (last.len == len && !memcmp(last.val, val, len))
+    return false;
+  memcpy(last.val, val, len);
+  last.len = len;
+  return true;
+}
+
+/**
+ * @brief Publishes a value to all registered listeners of a tag.
+ * 
+ * @param entry The dispatch table entry of the tag associated with the value.
+ * @param val The value to publish, NUL terminated.
+ * @param len Length of the value.
+ */
+void Mk2PVRouter::publish_value_(const DispatchEntry &entry, const char *val, size_t len) {
+  MK2PVROUTER_PROFILE_SCOPE(ProfilePhase::PUBLISH);
+  for (size_t j = entry.first; j < entry.first + entry.count; j++) {
+    const auto i = dispatch_listeners_[j];
+    auto *element = mk2pvrouter_listeners_[i];
+    if (stores_values_(i))
+      store_value_(i, val, len);
+    else
+      element->publish_raw(val, len);
+  }
+}
+
+/**
+ * @brief Records a value in the batch of the frame in progress.
+ * 
+ * @param entry The dispatch table entry of the tag associated with the value.
+ * @param val The value to record, NUL terminated.
+ * @param len Length of the value.
+ */
+void Mk2PVRouter::record_value_(InputLine &line, const DispatchEntry &entry, const char *val, size_t len) {
+  auto &records = line.batches[line.filling_batch].records;
+  const uint16_t index = &entry - dispatch_table_.data();
+  FrameRecord *record = nullptr;
+
+  /* A value of the incomplete frame is replaced by the one of the frame completing it */
+  if (line.partial_frame) {
+    for (auto &previous : records) {
+      if (previous.entry == index) {
+        record = &previous;
+        break;
       }
-      state_ = State::OFF;
+    }
+  }
+  if (record == nullptr) {
+    records.emplace_back();
+    record = &records.back();
+  }
+  record->entry = index;
+  /* Value length has already been checked against MAX_VAL_SIZE by the parser */
+  memcpy(record->val, val, len + 1);
+  record->len = len;
+}
+
+/**
+ * @brief Publishes the values of the frame of an input line handed off by on_frame_end_(), if any.
+ * 
+ * @details The values of a frame are published together, from a single loop() call, once the frame
+ * is complete. When max_publish_per_loop is set, the publication resumes in the next loop() calls
+ * once that many values are published, to keep each call short on frames with many listeners.
+ * Likewise with max_time_per_loop, once the time budget of the loop() call is exceeded, reading
+ * included. At least one value is published per call, so that a busy line does not starve the batch.
+ * 
+ * @param line The input line.
+ * @param start Time when the loop() call started (us).
+ */
+void Mk2PVRouter::publish_batch_(InputLine &line, uint32_t start) {
+  auto &batch = line.batches[line.filling_batch ^ 1];
+
+  if (!batch.ready)
+    return;
+  size_t end = batch.records.size();
+  if (max_publish_per_loop_)
+    end = std::min<size_t>(end, batch.published + max_publish_per_loop_);
+  for (; batch.published < end; batch.published++) {
+    const auto &record = batch.records[batch.published];
+    publish_value_(dispatch_table_[record.entry], record.val, record.len);
+    if (max_loop_time_ && micros() - start >= max_loop_time_) {
+      batch.published++;
       break;
+    }
+  }
+  if (batch.published < batch.records.size())
+    return;
+  batch.records.clear();
+  batch.ready = false;
+}
+
+/**
+ * @brief Merges the values of a frame into the batch still waiting to be published.
+ *
+ * @details The values of the waiting batch not published yet are kept, unless the newer batch has
+ * a value of the same tag, which replaces them. The values of the tags whose listeners aggregate or
+ * integrate them are all kept, the older ones first.
+ *
+ * @param waiting The batch waiting to be published, possibly in part already.
+ * @param newer The batch of the frame just ended.
+ */
+void Mk2PVRouter::merge_batch_(FrameBatch &waiting, const FrameBatch &newer) {
+  auto &records = waiting.records;
+  size_t kept = 0;
+
+  for (size_t i = waiting.published; i < records.size(); i++) {
+    const auto &record = records[i];
+    bool replaced = false;
+    if (!dispatch_table_[record.entry].aggregated) {
+      for (const auto &value : newer.records) {
+        if (value.entry == record.entry) {
+          replaced = true;
+          break;
+        }
+      }
+    }
+    if (!replaced)
+      records[kept++] = record;
+  }
+  records.resize(kept);
+  records.insert(records.end(), newer.records.begin(), newer.records.end());
+  waiting.published = 0;
+}
+
+/**
+ * @brief Copies a value to the snapshot of the frame in progress, decoded as a number when possible.
+ * 
+ * @param entry The dispatch table entry of the tag associated with the value.
+ * @param val The value, NUL terminated.
+ * @param len Length of the value.
+ */
+void Mk2PVRouter::snapshot_value_(InputLine &line, const DispatchEntry &entry, const char *val, size_t len) {
+  /* The first frame callback was registered during the frame */
+  if (entry.tag_index >= line.snapshot.values.size())
+    return;
+  auto &value = line.snapshot.values[entry.tag_index];
+  /* Value length has already been checked against MAX_VAL_SIZE by the parser */
+  memcpy(value.raw, val, len + 1);
+  value.len = len;
+  value.received = true;
+  if (!decode_fixed_point(val, len, 0, &value.number))
+    value.number = NAN;
+}
+
+/**
+ * @brief Finds the slot of a listened tag in the frame snapshots.
+ * 
+ * @note The slots are assigned by setup(), so they are looked up once from there on, typically by
+ * a static variable of the frame callback.
+ * 
+ * @param tag The tag.
+ * @param input The input of the tag, nullptr for the hub UART.
+ * @return int The slot of the tag, or -1 if no listener is registered for it.
+ */
+int Mk2PVRouter::find_snapshot_slot(const std::string &tag, Mk2PVRouterInput *input) const {
+  for (size_t i = 0; i < lines_.size(); i++) {
+    if (input == nullptr ? i != 0 : lines_[i]->device != input)
+      continue;
+    const auto *entry = find_dispatch_entry_(i, tag.c_str(), hash_tag(tag.c_str(), tag.size()));
+    return entry != nullptr ? entry->tag_index : -1;
+  }
+  return -1;
+}
+
+/**
+ * @brief Tells whether the values of a listener are stored in its slot, instead of being published
+ * as they are received.
+ * 
+ * @param index Index of the listener.
+ * @return true In continuous mode, or when the listener has its own update interval.
+ */
+bool Mk2PVRouter::stores_values_(size_t index) const {
+  return continuous_ || mk2pvrouter_listeners_[index]->get_update_interval();
+}
+
+/**
+ * @brief Allocates the slots of the listeners, when their values are stored, with their aggregate
+ * and update interval.
+ */
+void Mk2PVRouter::init_pending_values_() {
+  bool stores = false;
+
+  timed_listeners_.clear();
+  for (size_t i = 0; i < mk2pvrouter_listeners_.size(); i++) {
+    stores |= stores_values_(i);
+    if (mk2pvrouter_listeners_[i]->get_update_interval())
+      timed_listeners_.push_back(i);
+  }
+  pending_values_.assign(stores ? mk2pvrouter_listeners_.size() : 0, PendingValue{});
+  for (size_t i = 0; i < pending_values_.size(); i++) {
+    auto &pending = pending_values_[i];
+    pending.aggregate = mk2pvrouter_listeners_[i]->get_aggregate().value_or(aggregate_);
+    pending.update_interval = mk2pvrouter_listeners_[i]->get_update_interval();
+    pending.last_publish = millis();
   }
 }
 
 /**
- * @brief Publishes a value to all registered listeners that match the given tag.
+ * @brief Stores a value in the slot of a listener until its next publication.
  * 
- * @param tag The tag associated with the value.
- * @param val The value to publish.
+ * @param index Index of the listener.
+ * @param val The value to store, NUL terminated.
+ * @param len Length of the value.
  */
-void Mk2PVRouter::publish_value_(const std::string &tag, const std::string &val) {
-  for (auto *element : mk2pvrouter_listeners_) {
-    if (tag != element->tag)
+void Mk2PVRouter::store_value_(size_t index, const char *val, size_t len) {
+  auto &pending = pending_values_[index];
+  float number;
+
+  /* Value length has already been checked against MAX_VAL_SIZE by the parser */
+  memcpy(pending.last, val, len + 1);
+  pending.len = len;
+  pending.pending = true;
+  if (pending.aggregate == Aggregate::LAST || !mk2pvrouter_listeners_[index]->decode_val(val, len, &number))
+    return;
+  if (!pending.count)
+    pending.value = number;
+  else if (pending.aggregate == Aggregate::MEAN)
+    pending.value += number;
+  else if (pending.aggregate == Aggregate::MIN)
+    pending.value = std::min(pending.value, number);
+  else
+    pending.value = std::max(pending.value, number);
+  pending.count++;
+}
+
+/**
+ * @brief Publishes, and clears, the values stored in the slot of a listener.
+ * 
+ * @note Listeners that decoded their values get their aggregate, the others the last value received.
+ * 
+ * @param index Index of the listener.
+ */
+void Mk2PVRouter::publish_pending_value_(size_t index) {
+  auto &pending = pending_values_[index];
+
+  if (!pending.pending)
+    return;
+  if (pending.count)
+    mk2pvrouter_listeners_[index]->publish_number(pending.aggregate == Aggregate::MEAN ? pending.value / pending.count
+                                                                                      : pending.value);
+  else
+    mk2pvrouter_listeners_[index]->publish_raw(pending.last, pending.len);
+  pending.pending = false;
+  pending.count = 0;
+}
+
+/**
+ * @brief Publishes the values stored since the last update() for the listeners without their own
+ * update interval.
+ */
+void Mk2PVRouter::publish_pending_values_() {
+  for (size_t i = 0; i < pending_values_.size(); i++) {
+    if (!pending_values_[i].update_interval)
+      publish_pending_value_(i);
+  }
+}
+
+/**
+ * @brief Publishes the values stored for the listeners whose update interval elapsed.
+ */
+void Mk2PVRouter::publish_timed_values_() {
+  const uint32_t now = millis();
+
+  for (const auto i : timed_listeners_) {
+    auto &pending = pending_values_[i];
+    if (now - pending.last_publish < pending.update_interval)
       continue;
-    element->publish_val(val);
+    pending.last_publish = now;
+    publish_pending_value_(i);
   }
 }
 
@@ -229,25 +986,165 @@ void Mk2PVRouter::publish_value_(const std::string &tag, const std::string &val)
  */
 void Mk2PVRouter::dump_config() {
   ESP_LOGCONFIG(TAG, "Mk2PVRouter:");
-  this->check_uart_settings(baud_rate_, 1, uart::UART_CONFIG_PARITY_NONE, 8);
+  ESP_LOGCONFIG(TAG, "  Baud rate: %" PRIu32, baud_rate_);
+  ESP_LOGCONFIG(TAG, "  Checksum mode: %s", checksum_mode_ == ChecksumMode::HISTORICAL ? "historical" : "standard");
+  ESP_LOGCONFIG(TAG, "  Max bytes per loop: %" PRIu32 "%s", max_bytes_per_loop_,
+                adaptive_budget_ ? " (adaptive)" : "");
+  if (max_loop_time_)
+    ESP_LOGCONFIG(TAG, "  Max time per loop: %" PRIu32 "us", max_loop_time_);
+#ifdef USE_ESP32
+  ESP_LOGCONFIG(TAG, "  Reader task: %s", YESNO(reader_running_));
+#endif
+  ESP_LOGCONFIG(TAG, "  Verify all CRC: %s", YESNO(verify_all_crc_));
+  if (max_publish_per_loop_)
+    ESP_LOGCONFIG(TAG, "  Max publish per loop: %u", max_publish_per_loop_);
+  if (stale_timeout_)
+    ESP_LOGCONFIG(TAG, "  Stale timeout: %" PRIu32 "ms", stale_timeout_);
+#ifdef MK2PVROUTER_PROFILE
+  ESP_LOGCONFIG(TAG, "  Profile interval: %" PRIu32 "ms", profile_interval_);
+#endif
+  ESP_LOGCONFIG(TAG, "  Publish on change: %s", YESNO(publish_on_change_));
+  ESP_LOGCONFIG(TAG, "  Continuous: %s", YESNO(continuous_));
+  if (continuous_)
+    ESP_LOGCONFIG(TAG, "  Aggregate: %s", aggregate_to_string(aggregate_));
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  ESP_LOGCONFIG(TAG, "  Binary frames: %u tags, up to %u groups", static_cast<unsigned>(binary_tags_.size()),
+                MAX_BINARY_GROUPS);
+#endif
+  if (lines_.size() > 1)
+    ESP_LOGCONFIG(TAG, "  Additional inputs: %u", static_cast<unsigned>(lines_.size() - 1));
+#ifdef USE_MK2PVROUTER_STREAM
+  if (stream_ != nullptr)
+    stream_->dump_config();
+#endif
+  LOG_UPDATE_INTERVAL(this);
+  for (auto *line : lines_)
+    line->device->check_uart_settings(baud_rate_, 1, uart::UART_CONFIG_PARITY_NONE, 8);
 }
 
 /**
- * @brief Constructor for the Mk2PVRouter class. Initializes default values for checksum_area_end_ and baud_rate_.
+ * @brief Constructor for the Mk2PVRouter class. Initializes default values for checksum_mode_ and baud_rate_.
  */
 Mk2PVRouter::Mk2PVRouter() {
-  checksum_area_end_ = 1;
+  checksum_mode_ = ChecksumMode::STANDARD;
   baud_rate_ = 9600;
+  lines_.push_back(new InputLine(this, this, 0));  // NOLINT(cppcoreguidelines-owning-memory)
 }
 
+/**
+ * @brief Adds an UART input, for another router whose listeners select it with their input.
+ * 
+ * @param input The additional input.
+ */
+void Mk2PVRouter::add_input(Mk2PVRouterInput *input) {
+  lines_.push_back(new InputLine(this, input, lines_.size()));  // NOLINT(cppcoreguidelines-owning-memory)
+}
+
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+/**
+ * @brief Names the tag of an ID of the binary frames, so that its listeners get its values.
+ * 
+ * @param id The ID.
+ * @param tag The tag.
+ */
+void Mk2PVRouter::add_binary_tag(uint8_t id, const std::string &tag) {
+  binary_tags_.push_back(BinaryTag{id, static_cast<uint8_t>(tag.size()), hash_tag(tag.c_str(), tag.size()), nullptr});
+  binary_names_.push_back(tag);
+}
+#endif
+
+#ifdef USE_BINARY_SENSOR
+/**
+ * @brief Sets the sensor telling whether complete frames keep coming on an input, for the stale timeout.
+ * 
+ * @param sensor The binary sensor, on while the link is ok.
+ * @param input The input, nullptr for the hub UART.
+ */
+void Mk2PVRouter::set_link_sensor(binary_sensor::BinarySensor *sensor, Mk2PVRouterInput *input) {
+  for (auto *line : lines_) {
+    if (input == nullptr ? line->index == 0 : line->device == input) {
+      line->link_sensor = sensor;
+      return;
+    }
+  }
+  ESP_LOGE(TAG, "The input of the link sensor is not one of this hub");
+}
+#endif
+
 /**
  * @brief Registers a listener to receive updates for specific tags.
  * 
  * @param listener Pointer to the listener to register.
  */
 void Mk2PVRouter::register_mk2pvrouter_listener(Mk2PVRouterListener *listener) {
+  listener->set_hub(this);
   mk2pvrouter_listeners_.push_back(listener);
 }
 
+/**
+ * @brief Counts a value that a listener could not decode, logged as the parse errors are, so that
+ * a malformed value repeated in every frame does not flood a slow serial logger.
+ *
+ * @param tag The tag of the value.
+ * @param val The value, NUL terminated.
+ */
+void Mk2PVRouter::report_invalid_value(const char *tag, const char *val) {
+  statistics_.invalid_values++;
+  if (error_log_allowed_())
+    ESP_LOGW(TAG, "Invalid value '%s' for tag %s", val, tag);
+}
+
+#ifdef MK2PVROUTER_PROFILE
+uint32_t profile_cycles() { return arch_get_cpu_cycle_count(); }
+
+static const char *const PROFILE_PHASE_NAMES[PROFILE_PHASES] = {"read", "parse", "crc", "group", "publish"};
+
+/**
+ * @brief Upper bound of the bucket holding the given quantile of the durations of a phase.
+ *
+ * @param histogram The histogram of the phase, not empty.
+ * @param quantile The quantile, in percent.
+ * @return uint32_t The bound (cycles), the longest duration for the last bucket.
+ */
+static uint32_t profile_quantile(const PhaseHistogram &histogram, uint32_t quantile) {
+  const uint64_t rank = (static_cast<uint64_t>(histogram.count) * quantile + 99) / 100;
+  uint64_t seen = 0;
+
+  for (size_t i = 0; i < PROFILE_BUCKETS - 1; i++) {
+    seen += histogram.buckets[i];
+    if (seen >= rank)
+      return std::min(histogram.max, (UINT32_C(2) << i) - 1);
+  }
+  return histogram.max;
+}
+
+/**
+ * @brief Logs the count, mean, median, 99th percentile and longest duration of each phase measured
+ * since the last summary, then starts the next one. Nothing is logged while the lines stay idle.
+ *
+ * @details The percentiles are the upper bounds of their power of two bucket. Durations are in CPU
+ * cycles, and in microseconds for the longest one.
+ */
+void Mk2PVRouter::log_profile_() {
+  const uint32_t cycles_per_us = std::max<uint32_t>(arch_get_cpu_freq_hz() / 1000000, 1);
+
+  last_profile_ = millis();
+  if (!profiler.get(ProfilePhase::READ).count)
+    return;
+  ESP_LOGD(TAG, "Profile (cycles):");
+  for (size_t i = 0; i < PROFILE_PHASES; i++) {
+    const auto &histogram = profiler.get(static_cast<ProfilePhase>(i));
+    if (!histogram.count)
+      continue;
+    ESP_LOGD(TAG, "  %-7s n=%" PRIu32 " mean=%" PRIu32 " p50<=%" PRIu32 " p99<=%" PRIu32 " max=%" PRIu32 " (%" PRIu32
+             "us)",
+             PROFILE_PHASE_NAMES[i], histogram.count, static_cast<uint32_t>(histogram.total / histogram.count),
+             profile_quantile(histogram, 50), profile_quantile(histogram, 99), histogram.max,
+             histogram.max / cycles_per_us);
+  }
+  profiler.reset();
+}
+#endif
+
 }  // namespace mk2pvrouter
 }  // namespace esphome
@@ -1,19 +1,62 @@
 #pragma once
 
 #include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/optional.h"
 #include "esphome/components/uart/uart.h"
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+#include "mk2pvrouter_parser.h"
+#include "mk2pvrouter_profile.h"
+#ifdef USE_MK2PVROUTER_STREAM
+#include "mk2pvrouter_stream.h"
+#endif
+#ifdef USE_ESP32
+#include "mk2pvrouter_ring.h"
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#include <atomic>
+#include <functional>
+#include <string>
 #include <vector>
 
 namespace esphome {
 namespace mk2pvrouter {
-/*
- * 198 bytes should be enough to contain a full session in historical mode with
- * three phases. But go with 1024 just to be sure.
+#ifdef USE_ESP32
+/* Bytes buffered between the reader task and loop(), about 1s at 9600 bauds */
+static const size_t READ_RING_SIZE = 1024;
+#endif
+
+/**
+ * @brief How the values received between two publications are combined.
+ * 
+ * MEAN, MIN and MAX only apply to the listeners that decode their values, the others get the last one.
+ */
+enum class Aggregate : uint8_t {
+  LAST,
+  MEAN,
+  MIN,
+  MAX,
+};
+
+/**
+ * @class Mk2PVRouterInput
+ * @brief Additional UART input of a hub, for the sites running several routers.
+ * 
+ * Each input has its own frame parser, and shares the dispatch table, the listener slots and the
+ * statistics of its hub.
  */
-static const uint8_t MAX_TAG_SIZE = 16;
-static const uint16_t MAX_VAL_SIZE = 16;
-static const uint16_t MAX_BUF_SIZE = 1048;
+class Mk2PVRouterInput : public uart::UARTDevice {};
+
+class Mk2PVRouter;
 
 /**
  * @class Mk2PVRouterListener
@@ -25,7 +68,240 @@ static const uint16_t MAX_BUF_SIZE = 1048;
 class Mk2PVRouterListener {
  public:
   std::string tag;
+  /**
+   * @brief Publishes a copy of a value.
+   * 
+   * @note Compatibility path, only called by the default publish_raw().
+   */
   virtual void publish_val(const std::string &val) {};
+  /**
+   * @brief Publishes a value without copying it out of the hub buffers.
+   * 
+   * @param val The value, NUL terminated. Only valid during the call.
+   * @param len Length of the value.
+   */
+  virtual void publish_raw(const char *val, size_t len) { publish_val(std::string(val, len)); }
+  /**
+   * @brief Decodes a value as a number, so that the hub can average it.
+   * 
+   * @param val The value, NUL terminated.
+   * @param len Length of the value.
+   * @return false If the listener does not handle numbers or the value is not a number.
+   */
+  virtual bool decode_val(const char *val, size_t len, float *out) { return false; }
+  /**
+   * @brief Publishes a number aggregated by the hub from values accepted by decode_val().
+   */
+  virtual void publish_number(float val) {}
+  /**
+   * @brief Tells that the router of the tag stopped sending, so the last value published is stale.
+   */
+  virtual void publish_stale() {}
+  /**
+   * @brief Tells whether the listener needs every value, the unchanged ones included, even with
+   * publish_on_change, such as an integrator of the value over time.
+   */
+  virtual bool needs_every_value() const { return false; }
+
+  /**
+   * @brief Publishes the values at most once per interval (ms), aggregated by the hub.
+   * 0, the default, publishes every frame, or on each update of the hub in continuous mode.
+   */
+  void set_update_interval(uint32_t update_interval) { update_interval_ = update_interval; }
+  uint32_t get_update_interval() const { return update_interval_; }
+  /**
+   * @brief Overrides the aggregate of the hub for this listener.
+   */
+  void set_aggregate(Aggregate aggregate) { aggregate_ = aggregate; }
+  const optional<Aggregate> &get_aggregate() const { return aggregate_; }
+  /**
+   * @brief Listens to the tag of the router on an additional input, instead of the hub UART.
+   */
+  void set_input(Mk2PVRouterInput *input) { input_ = input; }
+  Mk2PVRouterInput *get_input() const { return input_; }
+  /**
+   * @brief Hub the listener is registered to, which reports the values it could not decode.
+   */
+  void set_hub(Mk2PVRouter *hub) { hub_ = hub; }
+
+ protected:
+  uint32_t update_interval_{0};
+  optional<Aggregate> aggregate_{};
+  Mk2PVRouterInput *input_{nullptr};
+  Mk2PVRouter *hub_{nullptr};
+};
+
+/**
+ * @brief Slot of a listener, for the values received since its last publication in continuous
+ * mode or with its own update interval.
+ */
+struct PendingValue {
+  char last[MAX_VAL_SIZE];
+  uint8_t len;
+  Aggregate aggregate;
+  bool pending;
+  /* Number of decoded values, and their sum, min or max depending on the aggregate */
+  uint16_t count;
+  float value;
+  /* Update interval of the listener (ms), and time of its last publication */
+  uint32_t update_interval;
+  uint32_t last_publish;
+};
+
+/**
+ * @brief Entry of the tag dispatch table, pointing to the listeners of one tag of one input.
+ * 
+ * An entry without listeners (count is 0) is empty.
+ */
+struct DispatchEntry {
+  uint32_t hash;
+  uint16_t first;
+  uint16_t count;
+  uint16_t tag_index;
+  /* Index of the input line of the tag, 0 for the hub UART */
+  uint8_t line;
+  /* A listener aggregates or integrates the values, so repeated ones count */
+  bool aggregated;
+};
+
+/**
+ * @brief Last value received for a tag, to only dispatch the values that changed.
+ * 
+ * A len of 0 means that no value has been received yet.
+ */
+struct LastValue {
+  char val[MAX_VAL_SIZE];
+  uint8_t len;
+};
+
+/**
+ * @brief Value of a listened tag received in a frame, kept until the frame is published.
+ */
+struct FrameRecord {
+  /* Index of the dispatch table entry of the tag */
+  uint16_t entry;
+  uint8_t len;
+  char val[MAX_VAL_SIZE];
+};
+
+/**
+ * @brief Values of the listened tags of one frame.
+ * 
+ * Records are cleared without releasing their storage, so that a batch only allocates while
+ * receiving its first frames.
+ */
+struct FrameBatch {
+  std::vector<FrameRecord> records;
+  /* Number of records already published, when limited per loop() call */
+  uint16_t published;
+  /* The frame is complete and waits for loop() to publish it */
+  bool ready;
+};
+
+/**
+ * @brief Value of a listened tag in a frame snapshot.
+ */
+struct SnapshotValue {
+  char raw[MAX_VAL_SIZE];
+  uint8_t len;
+  /* The tag was received in the frame of the snapshot, otherwise the other fields are stale */
+  bool received;
+  /* The value decoded as a number, NAN when it is not one */
+  float number;
+};
+
+/**
+ * @brief Values of the listened tags of a complete frame of an input line, for the frame callbacks.
+ * 
+ * The snapshot of a line is allocated once and filled in place as the groups of each frame are
+ * received. It holds one value per listened tag of the hub, at the slot returned by
+ * Mk2PVRouter::find_snapshot_slot(), so that consumers read the values of a same frame together
+ * without looking up their tags.
+ */
+struct FrameSnapshot {
+  /* Index of the input line of the frame, 0 for the hub UART */
+  uint8_t line;
+  /* Time of the end frame (ms) */
+  uint32_t timestamp;
+  std::vector<SnapshotValue> values;
+
+  /**
+   * @brief The value of a slot, or nullptr if its tag was not received in the frame.
+   */
+  const SnapshotValue *get(int slot) const {
+    if (slot < 0 || static_cast<size_t>(slot) >= values.size() || !values[slot].received)
+      return nullptr;
+    return &values[slot];
+  }
+};
+
+/**
+ * @brief Counters of the hub, since boot.
+ */
+struct Statistics {
+  /* Frames ended by an end frame (0x3) */
+  uint32_t frames_received;
+  /* Groups with a valid CRC, tag and value, only the listened ones unless verifying all CRC */
+  uint32_t groups_parsed;
+  uint32_t crc_errors;
+  uint32_t invalid_tags;
+  /* Groups with an empty, missing or too long value, and values a listener could not decode */
+  uint32_t invalid_values;
+  /* Values too long for their buffer, tags too long being skipped as nobody listens to them */
+  uint32_t overflows;
+  /* Frames ended in the middle of a group, or cut by the next start frame */
+  uint32_t dropped_frames;
+  /* Frames merged into the next one before loop() could publish them */
+  uint32_t skipped_frames;
+  /* Bytes dropped by the reader task because loop() did not consume them in time */
+  uint32_t lost_bytes;
+};
+
+/**
+ * @class InputLine
+ * @brief Parsing state of one UART input of the hub, which forwards the events of its parser to the hub.
+ */
+class InputLine : public FrameHandler {
+ public:
+  InputLine(Mk2PVRouter *hub, uart::UARTDevice *device, uint8_t index)
+      : hub(hub), device(device), index(index), parser(this) {}
+
+  Mk2PVRouter *hub;
+  uart::UARTDevice *device;
+  uint8_t index;
+  FrameParser parser;
+  /* Ping-pong batches, outside of continuous mode: one fills while the other waits to be published */
+  FrameBatch batches[2]{};
+  uint8_t filling_batch{0};
+  /* The filling batch starts with the values of an incomplete frame, completed by the next frame */
+  bool partial_frame{false};
+  /* Entry of the tag accepted for the group in progress, when skipping the unused groups */
+  const DispatchEntry *accepted_entry{nullptr};
+  /* Current byte budget, and UART backlog at the end of the last loop() call */
+  uint32_t byte_budget{128};
+  uint32_t last_available{0};
+  /* Time spent parsing the frame in progress (us), only measured when a frame time sensor is set */
+  uint32_t chunk_start{0};
+  uint32_t frame_time{0};
+  /* Time of the last complete frame (ms), and whether none was received since the stale timeout, or ever */
+  uint32_t last_frame{0};
+  bool stale{false};
+#ifdef USE_BINARY_SENSOR
+  binary_sensor::BinarySensor *link_sensor{nullptr};
+#endif
+  /* Values of the frame in progress, only filled when a frame callback is registered */
+  FrameSnapshot snapshot{};
+#ifdef USE_ESP32
+  /* Filled by the reader task, when it runs */
+  SpscRing<READ_RING_SIZE> *ring{nullptr};
+#endif
+
+ protected:
+  void on_frame_start() override;
+  bool accept_tag(const char *tag, size_t tag_len, uint32_t tag_hash) override;
+  void on_group(const char *tag, size_t tag_len, uint32_t tag_hash, const char *val, size_t val_len) override;
+  void on_frame_end(bool complete) override;
+  void on_error(ParseError error) override;
 };
 
 /**
@@ -36,36 +312,195 @@ class Mk2PVRouterListener {
  * extracts tags and values, and publishes them to registered listeners.
  */
 class Mk2PVRouter : public PollingComponent, public uart::UARTDevice {
+  friend class InputLine;
+
  public:
   Mk2PVRouter();
   void register_mk2pvrouter_listener(Mk2PVRouterListener *listener);
+  void add_input(Mk2PVRouterInput *input);
+  void report_invalid_value(const char *tag, const char *val);
   void loop() override;
   void setup() override;
   void update() override;
   void dump_config() override;
+  void set_baud_rate(uint32_t baud_rate) { baud_rate_ = baud_rate; }
+  void set_checksum_mode(ChecksumMode checksum_mode) { checksum_mode_ = checksum_mode; }
+  void set_continuous(bool continuous) { continuous_ = continuous; }
+  void set_aggregate(Aggregate aggregate) { aggregate_ = aggregate; }
+  void set_publish_on_change(bool publish_on_change) { publish_on_change_ = publish_on_change; }
+  void set_max_bytes_per_loop(uint32_t max_bytes) { max_bytes_per_loop_ = max_bytes; }
+  void set_max_loop_time(uint32_t max_loop_time) { max_loop_time_ = max_loop_time; }
+  void set_adaptive_budget(bool adaptive_budget) { adaptive_budget_ = adaptive_budget; }
+  void set_verify_all_crc(bool verify_all_crc) { verify_all_crc_ = verify_all_crc; }
+  void set_max_publish_per_loop(uint16_t max_publish) { max_publish_per_loop_ = max_publish; }
+  void set_stale_timeout(uint32_t stale_timeout) { stale_timeout_ = stale_timeout; }
+#ifdef MK2PVROUTER_PROFILE
+  void set_profile_interval(uint32_t profile_interval) { profile_interval_ = profile_interval; }
+#endif
+#ifdef USE_ESP32
+  void set_reader_task(bool reader_task) { reader_task_ = reader_task; }
+#endif
+#ifdef USE_MK2PVROUTER_STREAM
+  void set_stream(StreamSink *stream) { stream_ = stream; }
+#endif
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  void add_binary_tag(uint8_t id, const std::string &tag);
+#endif
+  const Statistics &get_statistics() const { return statistics_; }
+  /**
+   * @brief Calls back with the snapshot of each complete frame, before its values are published
+   * to the listeners.
+   */
+  void add_on_frame_callback(std::function<void(const FrameSnapshot &)> &&callback) {
+    frame_callback_.add(std::move(callback));
+    snapshots_ = true;
+  }
+  int find_snapshot_slot(const std::string &tag, Mk2PVRouterInput *input = nullptr) const;
+#ifdef USE_SENSOR
+  void set_frames_received_sensor(sensor::Sensor *sensor) { frames_received_sensor_ = sensor; }
+  void set_groups_parsed_sensor(sensor::Sensor *sensor) { groups_parsed_sensor_ = sensor; }
+  void set_crc_errors_sensor(sensor::Sensor *sensor) { crc_errors_sensor_ = sensor; }
+  void set_invalid_tags_sensor(sensor::Sensor *sensor) { invalid_tags_sensor_ = sensor; }
+  void set_invalid_values_sensor(sensor::Sensor *sensor) { invalid_values_sensor_ = sensor; }
+  void set_overflows_sensor(sensor::Sensor *sensor) { overflows_sensor_ = sensor; }
+  void set_dropped_frames_sensor(sensor::Sensor *sensor) { dropped_frames_sensor_ = sensor; }
+  void set_skipped_frames_sensor(sensor::Sensor *sensor) { skipped_frames_sensor_ = sensor; }
+  void set_lost_bytes_sensor(sensor::Sensor *sensor) { lost_bytes_sensor_ = sensor; }
+  void set_frame_time_min_sensor(sensor::Sensor *sensor) {
+    frame_time_min_sensor_ = sensor;
+    timing_ = true;
+  }
+  void set_frame_time_mean_sensor(sensor::Sensor *sensor) {
+    frame_time_mean_sensor_ = sensor;
+    timing_ = true;
+  }
+  void set_frame_time_max_sensor(sensor::Sensor *sensor) {
+    frame_time_max_sensor_ = sensor;
+    timing_ = true;
+  }
+#endif
+#ifdef USE_BINARY_SENSOR
+  void set_link_sensor(binary_sensor::BinarySensor *sensor, Mk2PVRouterInput *input = nullptr);
+#endif
   std::vector<Mk2PVRouterListener *> mk2pvrouter_listeners_{};
 
  protected:
   uint32_t baud_rate_;
-  int checksum_area_end_;
-  char buf_[MAX_BUF_SIZE];
-  uint32_t buf_index_{0};
-  char tag_[MAX_TAG_SIZE];
-  char val_[MAX_VAL_SIZE];
-
-  enum class State {
-    OFF,
-    ON,
-    START_FRAME_RECEIVED,
-    END_FRAME_RECEIVED,
-  };
-  
-  State state_{State::OFF};
-
-  bool read_chars_until_(bool drop, uint8_t c);
-  uint8_t calculate_crc_(const char *grp, int grp_len);
-  bool check_crc_(const char *grp, const char *grp_end);
-  void publish_value_(const std::string &tag, const std::string &val);
+  ChecksumMode checksum_mode_;
+  /* Read budget of a loop() call, the time one in microseconds (0 when unlimited) */
+  uint32_t max_bytes_per_loop_{128};
+  uint32_t max_loop_time_{0};
+  bool adaptive_budget_{false};
+  /* Parse every frame, and only publish on update() */
+  bool continuous_{false};
+  Aggregate aggregate_{Aggregate::LAST};
+  /* One per listener, in continuous mode or when a listener has its own update interval */
+  std::vector<PendingValue> pending_values_{};
+  /* Indexes of the listeners with their own update interval */
+  std::vector<uint16_t> timed_listeners_{};
+  /* Only dispatch values that differ from the last one received for their tag */
+  bool publish_on_change_{false};
+  /* One per listened tag, when publishing on change */
+  std::vector<LastValue> last_values_{};
+  /* Open addressing table of the listened (input, tag), and the listener indexes grouped by them */
+  std::vector<DispatchEntry> dispatch_table_{};
+  std::vector<uint16_t> dispatch_listeners_{};
+  /* Check the CRC of the groups nobody listens to, instead of skipping them once their tag is known */
+  bool verify_all_crc_{false};
+  /* Values of a frame published per loop() call, the rest in the next calls (0 when unlimited) */
+  uint16_t max_publish_per_loop_{0};
+  /* Time without complete frame (ms) after which the values of a line are stale (0 when disabled) */
+  uint32_t stale_timeout_{0};
+  /* Number of listened (input, tag), which each get a dispatch table entry and a snapshot slot */
+  uint16_t tag_count_{0};
+  /* Fill the frame snapshots, once a frame callback is registered */
+  bool snapshots_{false};
+  CallbackManager<void(const FrameSnapshot &)> frame_callback_{};
+  /* The hub UART, then the additional inputs */
+  std::vector<InputLine *> lines_{};
+#ifdef USE_ESP32
+  /* Drain the UARTs from a dedicated task into the rings of the lines, loop() only parses and publishes */
+  bool reader_task_{false};
+  bool reader_running_{false};
+  TaskHandle_t reader_handle_{nullptr};
+  std::atomic<uint32_t> lost_bytes_{0};
+#endif
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  /* Tags of the IDs of the binary frames, sorted by ID once set up, and the storage of their names */
+  std::vector<BinaryTag> binary_tags_{};
+  std::vector<std::string> binary_names_{};
+#endif
+#ifdef USE_MK2PVROUTER_STREAM
+  /* Forwards the validated frames as received */
+  StreamSink *stream_{nullptr};
+#endif
+#ifdef MK2PVROUTER_PROFILE
+  /* Interval between two profile summaries (ms) */
+  uint32_t profile_interval_{60000};
+  uint32_t last_profile_{0};
+#endif
+
+  Statistics statistics_{};
+  /* Rate limiting of the error logs */
+  uint32_t last_error_log_{0};
+  uint32_t suppressed_errors_{0};
+  /* Measure the frame parsing times, only when a frame time sensor is set */
+  bool timing_{false};
+  /* Frame times since the last update() */
+  uint32_t frame_time_min_{UINT32_MAX};
+  uint32_t frame_time_max_{0};
+  uint32_t frame_time_total_{0};
+  uint32_t frame_time_count_{0};
+#ifdef USE_SENSOR
+  sensor::Sensor *frames_received_sensor_{nullptr};
+  sensor::Sensor *groups_parsed_sensor_{nullptr};
+  sensor::Sensor *crc_errors_sensor_{nullptr};
+  sensor::Sensor *invalid_tags_sensor_{nullptr};
+  sensor::Sensor *invalid_values_sensor_{nullptr};
+  sensor::Sensor *overflows_sensor_{nullptr};
+  sensor::Sensor *dropped_frames_sensor_{nullptr};
+  sensor::Sensor *skipped_frames_sensor_{nullptr};
+  sensor::Sensor *lost_bytes_sensor_{nullptr};
+  sensor::Sensor *frame_time_min_sensor_{nullptr};
+  sensor::Sensor *frame_time_mean_sensor_{nullptr};
+  sensor::Sensor *frame_time_max_sensor_{nullptr};
+#endif
+
+  void on_frame_start_(InputLine &line);
+  bool accept_tag_(InputLine &line, const char *tag, uint32_t tag_hash);
+  void on_group_(InputLine &line, const char *tag, uint32_t tag_hash, const char *val, size_t val_len);
+  void on_frame_end_(InputLine &line, bool complete);
+  void on_error_(InputLine &line, ParseError error);
+
+  void read_chars_(uint32_t start);
+  bool read_line_(InputLine &line, uint32_t start);
+  size_t read_input_(InputLine &line, uint8_t *data, size_t len);
+  size_t input_backlog_(InputLine &line);
+#ifdef USE_ESP32
+  static void reader_task_func_(void *arg);
+#endif
+  bool error_log_allowed_();
+  void publish_statistics_();
+#ifdef MK2PVROUTER_PROFILE
+  void log_profile_();
+#endif
+  int find_line_(const Mk2PVRouterListener *listener) const;
+  void build_dispatch_table_();
+  const DispatchEntry *find_dispatch_entry_(uint8_t line, const char *tag, uint32_t hash) const;
+  bool value_changed_(const DispatchEntry &entry, const char *val, size_t len);
+  void publish_value_(const DispatchEntry &entry, const char *val, size_t len);
+  void record_value_(InputLine &line, const DispatchEntry &entry, const char *val, size_t len);
+  void publish_batch_(InputLine &line, uint32_t start);
+  void merge_batch_(FrameBatch &waiting, const FrameBatch &newer);
+  void snapshot_value_(InputLine &line, const DispatchEntry &entry, const char *val, size_t len);
+  bool stores_values_(size_t index) const;
+  void init_pending_values_();
+  void store_value_(size_t index, const char *val, size_t len);
+  void publish_pending_value_(size_t index);
+  void publish_pending_values_();
+  void publish_timed_values_();
+  void check_stale_lines_();
+  void set_line_stale_(InputLine &line, bool stale);
 };
 }  // namespace mk2pvrouter
 }  // namespace esphome
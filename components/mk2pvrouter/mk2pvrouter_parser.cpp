@@ -0,0 +1,557 @@
+#include "mk2pvrouter_parser.h"
+#include "mk2pvrouter_profile.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace mk2pvrouter {
+
+constexpr uint8_t START_OF_HEADER = 0x1;
+constexpr uint8_t START_FRAME = 0x2;
+constexpr uint8_t END_FRAME = 0x3;
+constexpr uint8_t LINE_FEED = 0xa;
+constexpr uint8_t CARRIAGE_RETURN = 0xd;
+constexpr uint8_t TAB = 0x9;
+/* Every delimiter above is lower than this, so a word without such a byte has no delimiter */
+constexpr uint8_t DELIMITER_BOUND = 0xe;
+
+/* At most 19 digits fit in 64 bits */
+constexpr uint8_t MAX_DIGITS = 19;
+
+/* Divisors for the digits after the decimal point, implied ones included */
+static const float POW10[MAX_DIGITS + MAX_DECIMALS + 1] = {
+    1e0f,  1e1f,  1e2f,  1e3f,  1e4f,  1e5f,  1e6f,  1e7f,  1e8f,  1e9f,  1e10f, 1e11f, 1e12f,
+    1e13f, 1e14f, 1e15f, 1e16f, 1e17f, 1e18f, 1e19f, 1e20f, 1e21f, 1e22f, 1e23f, 1e24f, 1e25f,
+};
+
+uint32_t hash_tag(const char *tag, size_t len) {
+  uint32_t hash = FNV1A_OFFSET_BASIS;
+  for (size_t i = 0; i < len; i++)
+    hash = hash_char(hash, tag[i]);
+  return hash;
+}
+
+/**
+ * @brief Decodes a signed decimal integer or fixed-point number, such as "-1234" or "12.5".
+ *
+ * @details Digits are accumulated into a 64 bits integer, and the decimal point is applied with a
+ * single division at the end, which is much cheaper than strtof() and its locale handling.
+ */
+bool decode_fixed_point(const char *val, size_t len, uint8_t decimals, float *out) {
+  const char *end = val + len;
+  bool negative = false;
+  bool point = false;
+  uint8_t digits = 0;
+  uint8_t fraction = decimals;
+  uint64_t acc = 0;
+
+  if (val < end && (*val == '-' || *val == '+'))
+    negative = *val++ == '-';
+  for (; val < end; val++) {
+    const uint8_t digit = *val - '0';
+    if (digit < 10) {
+      if (++digits > MAX_DIGITS)
+        return false;
+      acc = acc * 10 + digit;
+      fraction += point;
+    } else if (*val == '.' && !point) {
+      point = true;
+    } else {
+      return false;
+    }
+  }
+  if (!digits || fraction > MAX_DIGITS + MAX_DECIMALS)
+    return false;
+
+  *out = static_cast<float>(acc) / POW10[fraction];
+  if (negative)
+    *out = -*out;
+  return true;
+}
+
+/**
+ * @brief Calculates the CRC (checksum) from the sum of the bytes of the checksum area of a group.
+ *
+ * @param sum Sum (modulo 256) of the bytes of the checksum area.
+ * @return uint8_t The calculated CRC value.
+ */
+static uint8_t calculate_crc(uint8_t sum) {
+  uint8_t crc_tmp = sum;
+  crc_tmp &= 0x3F;
+  crc_tmp += 0x20;
+  return crc_tmp;
+}
+
+/**
+ * @brief Calculates the CRC of the last group received, or of the binary frame whose CRC is being checked.
+ *
+ * @details The running sum covers every byte of the group, the provided CRC included. The bytes
+ * that are not part of the checksum area (the CRC, and the preceding separator in historical mode)
+ * are taken back out before computing the CRC.
+ * The groups of a binary frame are handed off with the checksum of an ASCII group, which matches.
+ *
+ * @return uint16_t The calculated CRC value.
+ */
+uint16_t FrameParser::get_calculated_crc() const {
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  if (binary_frame_)
+    return state_ == State::BINARY_CRC ? binary_crc_ : last_char_;
+#endif
+  uint8_t sum = crc_sum_ - last_char_;
+  if (checksum_mode_ == ChecksumMode::HISTORICAL)
+    sum -= prev_char_;
+  return calculate_crc(sum);
+}
+
+/**
+ * @brief Received CRC of the last group, or of the binary frame whose CRC is being checked.
+ */
+uint16_t FrameParser::get_received_crc() const {
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  if (binary_frame_ && state_ == State::BINARY_CRC)
+    return binary_received_crc_;
+#endif
+  return last_char_;
+}
+
+/**
+ * @brief Verifies the CRC of the group just received by comparing the calculated CRC with the provided CRC.
+ *
+ * @return true If the CRC matches.
+ * @return false If there is a mismatch, which is reported to the handler.
+ */
+bool FrameParser::check_crc_() {
+  MK2PVROUTER_PROFILE_SCOPE(ProfilePhase::CRC);
+  if (last_char_ != get_calculated_crc()) {
+    handler_->on_error(ParseError::CRC_MISMATCH);
+    return false;
+  }
+  return true;
+}
+
+#ifdef MK2PVROUTER_SWAR
+/**
+ * @brief Tells whether a word has a byte lower than n (n <= 128).
+ */
+static inline uint32_t has_less(uint32_t w, uint8_t n) { return (w - 0x01010101UL * n) & ~w & 0x80808080UL; }
+
+/**
+ * @brief Scans the leading bytes that cannot be delimiters, and sums them.
+ *
+ * @details Between the unaligned head and tail, which are scanned a byte at a time, bytes are
+ * loaded a 32 bits word at a time. A word is checked for delimiters with a single has-less-than
+ * test, and its bytes are summed two 16 bits lanes at a time.
+ *
+ * @param data The received characters.
+ * @param len Number of characters.
+ * @param sum The sum (modulo 256) of the scanned bytes.
+ * @return size_t Number of leading bytes of data that cannot be delimiters.
+ */
+static size_t scan_plain(const uint8_t *data, size_t len, uint8_t *sum) {
+  size_t i = 0;
+  uint8_t head = 0;
+  uint32_t lanes = 0;
+
+  while (i < len && (reinterpret_cast<uintptr_t>(data + i) & 3)) {
+    if (data[i] < DELIMITER_BOUND) {
+      *sum = head;
+      return i;
+    }
+    head += data[i++];
+  }
+  /* Each word adds at most 510 to a lane, so 128 words fit in a 16 bits lane */
+  for (size_t words = 0; i + 4 <= len && words < 128; i += 4, words++) {
+    uint32_t w;
+    memcpy(&w, __builtin_assume_aligned(data + i, 4), sizeof(w));
+    if (has_less(w, DELIMITER_BOUND))
+      break;
+    lanes += (w & 0x00FF00FFUL) + ((w >> 8) & 0x00FF00FFUL);
+  }
+  while (i < len && data[i] >= DELIMITER_BOUND)
+    head += data[i++];
+
+  *sum = head + static_cast<uint8_t>(lanes) + static_cast<uint8_t>(lanes >> 16);
+  return i;
+}
+#endif
+
+/**
+ * @details When the word-at-a-time scanning is enabled, runs of bytes of the value and checksum
+ * fields, and the bytes dropped between or inside skipped groups, are consumed in bulk. The delimiters, and the tag
+ * which is hashed byte by byte, still go through parse_char().
+ */
+size_t FrameParser::feed(const uint8_t *data, size_t len) {
+  MK2PVROUTER_PROFILE_SCOPE(ProfilePhase::PARSE);
+  size_t i = 0;
+
+  while (i < len && state_ != State::OFF) {
+#ifdef MK2PVROUTER_SWAR
+    /* Delimiters go through parse_char() right away */
+    if (data[i] >= DELIMITER_BOUND && state_ <= State::SKIP_GROUP &&
+        (state_ != State::START_GROUP_RECEIVED || field_index_ > 0)) {
+      uint8_t sum;
+      const size_t run = scan_plain(data + i, len - i, &sum);
+      if (run) {
+        if (state_ == State::START_GROUP_RECEIVED)
+          add_group_run_(data + i, run, sum);
+        i += run;
+        continue;
+      }
+    }
+#endif
+    parse_char(data[i++]);
+  }
+  return i;
+}
+
+/**
+ * @brief Resets the fields of the group in progress after a Line Feed (0xa) has been received.
+ */
+void FrameParser::start_group_() {
+  tag_len_ = 0;
+  val_len_ = 0;
+  tag_hash_ = FNV1A_OFFSET_BASIS;
+  field_index_ = 0;
+  crc_sum_ = 0;
+  last_char_ = 0;
+  prev_char_ = 0;
+  state_ = State::START_GROUP_RECEIVED;
+}
+
+/**
+ * @brief Adds a character of the group in progress to the running CRC and to the current field.
+ *
+ * @details Fields are separated by TAB (0x9). The first one is the tag, the second one the value.
+ * Any following field (the CRC) is only accounted for in the running CRC.
+ * With the tag filter, a group whose tag is rejected by the handler is skipped up to its end.
+ * A field too long for its buffer is marked as overflowed and the group is rejected once complete.
+ * The tag buffer fits the longest tag listened to, so a longer tag is not an error: its group is
+ * skipped right away with the tag filter, or dropped once its CRC is checked.
+ *
+ * @param c The received character.
+ */
+void FrameParser::add_group_char_(uint8_t c) {
+  crc_sum_ += c;
+  prev_char_ = last_char_;
+  last_char_ = c;
+
+  if (c == TAB) {
+    if (field_index_ == 0 && tag_len_ < MAX_TAG_SIZE) {
+      tag_[tag_len_] = '\0';
+      if (tag_filter_ && !handler_->accept_tag(tag_, tag_len_, tag_hash_)) {
+        state_ = State::SKIP_GROUP;
+        return;
+      }
+    } else if (field_index_ == 0 && tag_filter_) {
+      /* A tag too long for its buffer cannot be listened to */
+      state_ = State::SKIP_GROUP;
+      return;
+    } else if (field_index_ == 1 && val_len_ < MAX_VAL_SIZE)
+      val_[val_len_] = '\0';
+    ++field_index_;
+    return;
+  }
+
+  /* Keep the last byte of the buffers for the terminating '\0' */
+  if (field_index_ == 0) {
+    if (tag_len_ < MAX_TAG_SIZE - 1) {
+      tag_[tag_len_++] = c;
+      tag_hash_ = hash_char(tag_hash_, c);
+    } else {
+      tag_len_ = MAX_TAG_SIZE;
+    }
+  } else if (field_index_ == 1) {
+    if (val_len_ < MAX_VAL_SIZE - 1) {
+      val_[val_len_++] = c;
+    } else if (val_len_ < MAX_VAL_SIZE) {
+      val_len_ = MAX_VAL_SIZE;
+      handler_->on_error(ParseError::FIELD_OVERFLOW);
+    }
+  }
+}
+
+/**
+ * @brief Adds a run of characters without delimiters of the value or checksum field in progress.
+ *
+ * @details Same as calling add_group_char_() for each character of the run.
+ *
+ * @param data The characters.
+ * @param len Number of characters, at least one.
+ * @param sum Sum (modulo 256) of the characters.
+ */
+void FrameParser::add_group_run_(const uint8_t *data, size_t len, uint8_t sum) {
+  crc_sum_ += sum;
+  prev_char_ = len > 1 ? data[len - 2] : last_char_;
+  last_char_ = data[len - 1];
+
+  if (field_index_ != 1)
+    return;
+  const size_t room = val_len_ < MAX_VAL_SIZE - 1 ? MAX_VAL_SIZE - 1 - val_len_ : 0;
+  const size_t copied = len < room ? len : room;
+  memcpy(val_ + val_len_, data, copied);
+  val_len_ += copied;
+  if (copied < len && val_len_ < MAX_VAL_SIZE) {
+    val_len_ = MAX_VAL_SIZE;
+    handler_->on_error(ParseError::FIELD_OVERFLOW);
+  }
+}
+
+/**
+ * @brief Validates the group just terminated by a Carriage Return (0xd) and hands it off to the handler.
+ */
+void FrameParser::end_group_() {
+  state_ = State::START_FRAME_RECEIVED;
+
+  if (!check_crc_())
+    return;
+
+  /* Nobody listens to a tag longer than the buffer */
+  if (tag_len_ >= MAX_TAG_SIZE)
+    return;
+  if (!tag_len_ || field_index_ < 1) {
+    handler_->on_error(ParseError::INVALID_TAG);
+    return;
+  }
+
+  if (!val_len_ || val_len_ >= MAX_VAL_SIZE || field_index_ < 2) {
+    handler_->on_error(ParseError::INVALID_VALUE);
+    return;
+  }
+
+  handler_->on_group(tag_, tag_len_, tag_hash_, val_, val_len_);
+}
+
+/**
+ * @brief Handles the end frame (0x3). The parser is idle until restarted, possibly by the handler.
+ *
+ * @param complete false If the frame ended in the middle of a group.
+ */
+void FrameParser::end_frame_(bool complete) {
+  state_ = State::OFF;
+  handler_->on_frame_end(complete);
+}
+
+/**
+ * @brief Handles a start frame (0x2) received in the middle of a frame: the frame in progress is
+ * ended as incomplete, and the new one starts right away if the handler restarted the parser.
+ */
+void FrameParser::resync_frame_() {
+  handler_->on_error(ParseError::NO_END_FRAME);
+  end_frame_(false);
+  if (state_ == State::OFF)
+    return;
+  state_ = State::START_FRAME_RECEIVED;
+  handler_->on_frame_start();
+}
+
+/**
+ * @details A corrupted group only costs that group: the parser resynchronizes on the next Line Feed
+ * (0xa) within the same frame, or on the next start frame (0x2).
+ */
+void FrameParser::parse_char(uint8_t c) {
+  switch (state_) {
+    case State::OFF:
+      break;
+    case State::ON:
+      /* Drop chars until start frame (0x2) */
+      if (c == START_FRAME) {
+        state_ = State::START_FRAME_RECEIVED;
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+        binary_frame_ = false;
+#endif
+        handler_->on_frame_start();
+      }
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+      else if (c == START_OF_HEADER) {
+        state_ = State::BINARY_COUNT;
+        binary_frame_ = true;
+        binary_crc_ = 0xFFFF;
+        handler_->on_frame_start();
+      }
+#endif
+      break;
+    case State::START_FRAME_RECEIVED:
+      /* Drop chars until start of group (0xa) or end frame (0x3) */
+      if (c == LINE_FEED)
+        start_group_();
+      else if (c == END_FRAME)
+        end_frame_(true);
+      else if (c == START_FRAME)
+        resync_frame_();
+      break;
+    case State::START_GROUP_RECEIVED:
+      if (c == CARRIAGE_RETURN) {
+        end_group_();
+      } else if (c == LINE_FEED) {
+        handler_->on_error(ParseError::NO_GROUP);
+        start_group_();
+      } else if (c == END_FRAME) {
+        handler_->on_error(ParseError::NO_GROUP);
+        end_frame_(false);
+      } else if (c == START_FRAME) {
+        resync_frame_();
+      } else {
+        add_group_char_(c);
+      }
+      break;
+    case State::SKIP_GROUP:
+      /* Drop chars until the end of group (0xd), with the same checks of the group framing */
+      if (c == CARRIAGE_RETURN) {
+        state_ = State::START_FRAME_RECEIVED;
+      } else if (c == LINE_FEED) {
+        handler_->on_error(ParseError::NO_GROUP);
+        start_group_();
+      } else if (c == END_FRAME) {
+        handler_->on_error(ParseError::NO_GROUP);
+        end_frame_(false);
+      } else if (c == START_FRAME) {
+        resync_frame_();
+      }
+      break;
+    case State::BINARY_COUNT:
+    case State::BINARY_GROUPS:
+    case State::BINARY_CRC:
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+      parse_binary_char_(c);
+#endif
+      break;
+  }
+}
+
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+/**
+ * @brief Adds a byte to a CRC-16/CCITT-FALSE (polynomial 0x1021).
+ */
+static uint16_t crc16_add(uint16_t crc, uint8_t c) {
+  crc ^= static_cast<uint16_t>(c) << 8;
+  for (uint8_t bit = 0; bit < 8; bit++)
+    crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  return crc;
+}
+
+/**
+ * @brief Formats a signed integer in decimal.
+ *
+ * @param value The integer.
+ * @param out Where to write the digits, with room for 11 characters and the NUL.
+ * @return size_t Number of characters written.
+ */
+static size_t format_int(int32_t value, char *out) {
+  char digits[10];
+  size_t len = 0;
+  size_t count = 0;
+  uint32_t abs = value < 0 ? 0u - static_cast<uint32_t>(value) : value;
+
+  do {
+    digits[count++] = '0' + abs % 10;
+    abs /= 10;
+  } while (abs);
+  if (value < 0)
+    out[len++] = '-';
+  while (count)
+    out[len++] = digits[--count];
+  out[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief Receives a byte of a binary frame: its count, its groups, which are buffered, then its CRC.
+ */
+void FrameParser::parse_binary_char_(uint8_t c) {
+  switch (state_) {
+    case State::BINARY_COUNT:
+      binary_crc_ = crc16_add(binary_crc_, c);
+      if (c > MAX_BINARY_GROUPS) {
+        handler_->on_error(ParseError::FIELD_OVERFLOW);
+        end_frame_(false);
+        return;
+      }
+      binary_len_ = c * BINARY_GROUP_SIZE;
+      binary_pos_ = 0;
+      state_ = binary_len_ ? State::BINARY_GROUPS : State::BINARY_CRC;
+      break;
+    case State::BINARY_GROUPS:
+      binary_crc_ = crc16_add(binary_crc_, c);
+      binary_groups_[binary_pos_++] = c;
+      if (binary_pos_ == binary_len_) {
+        binary_pos_ = 0;
+        state_ = State::BINARY_CRC;
+      }
+      break;
+    default:
+      if (!binary_pos_++) {
+        binary_received_crc_ = c;
+        break;
+      }
+      binary_received_crc_ |= static_cast<uint16_t>(c) << 8;
+      end_binary_frame_();
+      break;
+  }
+}
+
+/**
+ * @brief Finds the tag of an ID of the binary frames.
+ *
+ * @return const BinaryTag* The tag of the ID, or nullptr if it has none.
+ */
+const BinaryTag *FrameParser::find_binary_tag_(uint8_t id) const {
+  size_t low = 0;
+  size_t high = binary_tag_count_;
+
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (binary_tags_[mid].id < id)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low < binary_tag_count_ && binary_tags_[low].id == id ? &binary_tags_[low] : nullptr;
+}
+
+/**
+ * @brief Checks the CRC of the binary frame just received, then hands off its groups to the handler
+ * and ends the frame.
+ *
+ * @details Each group is handed off as an ASCII group would be, with the tag of its ID and its
+ * value in decimal, and the checksum of an ASCII group as its received CRC, so that the handler can
+ * process both formats alike. Groups whose ID has no tag, or whose tag is rejected by the tag filter
+ * or too long for the tag buffer, are ignored.
+ */
+void FrameParser::end_binary_frame_() {
+  if (binary_received_crc_ != binary_crc_) {
+    handler_->on_error(ParseError::CRC_MISMATCH);
+    end_frame_(false);
+    return;
+  }
+
+  state_ = State::START_FRAME_RECEIVED;
+  for (uint16_t pos = 0; pos < binary_len_; pos += BINARY_GROUP_SIZE) {
+    const uint8_t *group = binary_groups_ + pos;
+    const BinaryTag *tag = find_binary_tag_(group[0]);
+    if (tag == nullptr || tag->len >= MAX_TAG_SIZE)
+      continue;
+    memcpy(tag_, tag->tag, tag->len + 1);
+    tag_len_ = tag->len;
+    tag_hash_ = tag->hash;
+    if (tag_filter_ && !handler_->accept_tag(tag_, tag_len_, tag_hash_))
+      continue;
+    const uint32_t raw = group[1] | static_cast<uint32_t>(group[2]) << 8 | static_cast<uint32_t>(group[3]) << 16 |
+                         static_cast<uint32_t>(group[4]) << 24;
+    val_len_ = format_int(static_cast<int32_t>(raw), val_);
+    uint8_t sum = TAB + TAB;
+    for (uint8_t i = 0; i < tag_len_; i++)
+      sum += tag_[i];
+    for (uint16_t i = 0; i < val_len_; i++)
+      sum += val_[i];
+    last_char_ = calculate_crc(checksum_mode_ == ChecksumMode::HISTORICAL ? sum - TAB : sum);
+    handler_->on_group(tag_, tag_len_, tag_hash_, val_, val_len_);
+    /* The handler stopped or restarted the parser */
+    if (state_ != State::START_FRAME_RECEIVED)
+      return;
+  }
+  end_frame_(true);
+}
+#endif
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
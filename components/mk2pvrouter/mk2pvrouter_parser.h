@@ -0,0 +1,298 @@
+#pragma once
+
+/*
+ * Frame parser core of the Mk2PVRouter hub.
+ *
+ * It only depends on the C++ standard library, so that it can be built and
+ * exercised on a host, without the ESPHome UART and logging components.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Building with MK2PVROUTER_SWAR scans the bytes of the values a 32 bits word at a time, on the
+ * targets with cheap aligned word loads and shifts. It only pays off for values much longer than
+ * those of typical frames, which are faster with the byte-wise state machine (see parser_bench of
+ * tests/parser), so it is not enabled by default on any target.
+ */
+
+namespace esphome {
+namespace mk2pvrouter {
+/*
+ * Groups are parsed as they are received, so only the tag and the value of the
+ * group in progress need to be buffered. Their sizes, NUL included, are generated
+ * from the longest listened tag and the max_value_length option.
+ */
+#ifndef MK2PVROUTER_MAX_TAG_SIZE
+#define MK2PVROUTER_MAX_TAG_SIZE 16
+#endif
+#ifndef MK2PVROUTER_MAX_VAL_SIZE
+#define MK2PVROUTER_MAX_VAL_SIZE 16
+#endif
+static_assert(MK2PVROUTER_MAX_TAG_SIZE >= 2 && MK2PVROUTER_MAX_TAG_SIZE <= 255, "Invalid tag buffer size");
+static_assert(MK2PVROUTER_MAX_VAL_SIZE >= 2 && MK2PVROUTER_MAX_VAL_SIZE <= 255, "Invalid value buffer size");
+static const uint8_t MAX_TAG_SIZE = MK2PVROUTER_MAX_TAG_SIZE;
+static const uint16_t MAX_VAL_SIZE = MK2PVROUTER_MAX_VAL_SIZE;
+/* Largest number of implied decimals of a fixed-point value */
+static const uint8_t MAX_DECIMALS = 6;
+
+/*
+ * The compact binary frames are only recognized when their largest number of groups is
+ * generated, as they are buffered until their CRC is checked.
+ */
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+static_assert(MK2PVROUTER_MAX_BINARY_GROUPS >= 1 && MK2PVROUTER_MAX_BINARY_GROUPS <= 255,
+              "Invalid number of binary groups");
+static const uint8_t MAX_BINARY_GROUPS = MK2PVROUTER_MAX_BINARY_GROUPS;
+static_assert(MK2PVROUTER_MAX_VAL_SIZE >= 12, "The value buffer must fit a 32 bits integer in decimal");
+/* Tag ID, and value as a 32 bits little-endian signed integer */
+static const uint8_t BINARY_GROUP_SIZE = 5;
+
+/**
+ * @brief Tag of a numeric tag ID of the binary frames.
+ */
+struct BinaryTag {
+  uint8_t id;
+  uint8_t len;
+  uint32_t hash;
+  const char *tag;
+};
+#endif
+
+static const uint32_t FNV1A_OFFSET_BASIS = 2166136261UL;
+static const uint32_t FNV1A_PRIME = 16777619UL;
+
+/**
+ * @brief Adds a character to a FNV-1a hash.
+ *
+ * @param hash The hash of the previous characters, or FNV1A_OFFSET_BASIS.
+ * @param c The character to add.
+ * @return uint32_t The updated hash.
+ */
+inline uint32_t hash_char(uint32_t hash, uint8_t c) { return (hash ^ c) * FNV1A_PRIME; }
+
+/**
+ * @brief Computes the FNV-1a hash of a tag, as computed by the parser while receiving it.
+ *
+ * @param tag The tag.
+ * @param len Length of the tag.
+ * @return uint32_t The hash of the tag.
+ */
+uint32_t hash_tag(const char *tag, size_t len);
+
+/**
+ * @brief Decodes a signed decimal integer or fixed-point number, such as "-1234" or "12.5".
+ *
+ * @param val The value.
+ * @param len Length of the value.
+ * @param decimals Number of implied decimals of the value, up to MAX_DECIMALS: "1234" with 2 decimals is 12.34.
+ * @param out The decoded number.
+ * @return false If the value is not an optional sign followed by digits with at most one decimal point.
+ */
+bool decode_fixed_point(const char *val, size_t len, uint8_t decimals, float *out);
+
+/**
+ * @brief Area of a group covered by its checksum.
+ *
+ * - STANDARD: from the tag up to the separator preceding the checksum, included.
+ * - HISTORICAL: from the tag up to the separator preceding the checksum, excluded.
+ */
+enum class ChecksumMode : uint8_t {
+  STANDARD,
+  HISTORICAL,
+};
+
+/**
+ * @brief Errors reported by the frame parser.
+ */
+enum class ParseError : uint8_t {
+  /* The CRC of a group does not match its content */
+  CRC_MISMATCH,
+  /* A group has an empty tag, or no value field */
+  INVALID_TAG,
+  /* A group has an empty, missing or too long value */
+  INVALID_VALUE,
+  /* A value does not fit in its buffer (reported once per field) */
+  FIELD_OVERFLOW,
+  /* A group is not terminated by a Carriage Return (0xd) */
+  NO_GROUP,
+  /* A start frame (0x2) is received before the end frame (0x3) of the frame in progress */
+  NO_END_FRAME,
+};
+
+/**
+ * @class FrameHandler
+ * @brief Receives the events of a FrameParser.
+ */
+class FrameHandler {
+ public:
+  /**
+   * @brief Called when a start frame (0x2) is received.
+   */
+  virtual void on_frame_start() {}
+  /**
+   * @brief Called once the tag of a group is received, when the tag filter is enabled.
+   *
+   * @param tag The tag, NUL terminated. Only valid during the call.
+   * @param tag_len Length of the tag.
+   * @param tag_hash FNV-1a hash of the tag.
+   * @return false To skip the group: its value is neither copied nor checked.
+   */
+  virtual bool accept_tag(const char *tag, size_t tag_len, uint32_t tag_hash) { return true; }
+  /**
+   * @brief Called for each group with a valid CRC, tag and value.
+   *
+   * @param tag The tag, NUL terminated. Only valid during the call.
+   * @param tag_len Length of the tag.
+   * @param tag_hash FNV-1a hash of the tag.
+   * @param val The value, NUL terminated. Only valid during the call.
+   * @param val_len Length of the value.
+   */
+  virtual void on_group(const char *tag, size_t tag_len, uint32_t tag_hash, const char *val, size_t val_len) = 0;
+  /**
+   * @brief Called when an end frame (0x3) is received. The parser is then idle until restarted.
+   *
+   * @param complete false If the frame ended in the middle of a group.
+   */
+  virtual void on_frame_end(bool complete) {}
+  /**
+   * @brief Called for each parse error.
+   */
+  virtual void on_error(ParseError error) {}
+};
+
+/**
+ * @class FrameParser
+ * @brief Incremental parser of the Mk2PVRouter frames.
+ *
+ * Each frame is composed of multiple groups starting by 0xa (Line Feed) and ending by
+ * 0xd ('\r').
+ *
+ * Each group contains tag, data and a CRC separated by 0x9 (\t)
+ * 0xa | Tag | 0x9 | Data | 0x9 | CRC | 0xd
+ *     ^^^^^^^^^^^^^^^^^^^^^^^^^
+ * Checksum is computed on the above in standard mode.
+ *
+ * Groups are split into their fields and their CRC is summed as the bytes come in, so each group
+ * is handed off as soon as its 0xd is received, without buffering the whole frame.
+ *
+ * When enabled, compact binary frames are recognized alongside, by their start of header (0x1):
+ * 0x1 | Count | Count x (Tag ID | Value) | CRC
+ * with 8 bits tag IDs, 32 bits little-endian signed values and a CRC-16/CCITT-FALSE, little-endian,
+ * of the count and the groups. Their groups are handed off to the handler as the ASCII ones, once the
+ * CRC of the frame is checked, with the tag of their ID and their value in decimal.
+ */
+class FrameParser {
+ public:
+  explicit FrameParser(FrameHandler *handler) : handler_(handler) {}
+  void set_checksum_mode(ChecksumMode checksum_mode) { checksum_mode_ = checksum_mode; }
+  ChecksumMode get_checksum_mode() const { return checksum_mode_; }
+  /**
+   * @brief Asks the handler whether to parse each group once its tag is received.
+   */
+  void set_tag_filter(bool tag_filter) { tag_filter_ = tag_filter; }
+  bool get_tag_filter() const { return tag_filter_; }
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  /**
+   * @brief Sets the tags of the IDs of the binary frames, sorted by ID and kept by the caller.
+   * Groups of the other IDs are ignored.
+   */
+  void set_binary_tags(const BinaryTag *tags, size_t count) {
+    binary_tags_ = tags;
+    binary_tag_count_ = count;
+  }
+#endif
+
+  /**
+   * @brief Waits for the next start frame (0x2), dropping any frame in progress.
+   */
+  void start() { state_ = State::ON; }
+  /**
+   * @brief Ignores every character until restarted.
+   */
+  void stop() { state_ = State::OFF; }
+  bool is_idle() const { return state_ == State::OFF; }
+
+  /**
+   * @brief Feeds characters to the parser, until they are all consumed or the parser gets idle.
+   *
+   * @param data The received characters.
+   * @param len Number of characters.
+   * @return size_t Number of characters consumed.
+   */
+  size_t feed(const uint8_t *data, size_t len);
+  /**
+   * @brief Feeds one character to the parser state machine.
+   */
+  void parse_char(uint8_t c);
+
+  /*
+   * Details of the last group, for the error reports and the forwarded groups. While the CRC
+   * mismatch of a binary frame is reported, the CRCs are the ones of the frame.
+   */
+  const char *get_tag() const { return tag_; }
+  uint16_t get_received_crc() const;
+  uint16_t get_calculated_crc() const;
+
+ protected:
+  enum class State : uint8_t {
+    OFF,
+    ON,
+    START_FRAME_RECEIVED,
+    START_GROUP_RECEIVED,
+    /* Drops the rest of a group rejected by the tag filter */
+    SKIP_GROUP,
+    /* Receive the count, the groups and the CRC of a binary frame */
+    BINARY_COUNT,
+    BINARY_GROUPS,
+    BINARY_CRC,
+  };
+
+  FrameHandler *handler_;
+  ChecksumMode checksum_mode_{ChecksumMode::STANDARD};
+  bool tag_filter_{false};
+  State state_{State::OFF};
+
+  char tag_[MAX_TAG_SIZE]{};
+  char val_[MAX_VAL_SIZE]{};
+  /* Lengths of the fields of the group in progress, MAX_*_SIZE once they overflowed. */
+  uint8_t tag_len_{0};
+  uint16_t val_len_{0};
+  /* Hash of the tag of the group in progress, computed as it is received. */
+  uint32_t tag_hash_{0};
+  /* Index of the TAB separated field being received. */
+  uint8_t field_index_{0};
+  /* Running sum of the group bytes, and the two last bytes to take the CRC area end back out. */
+  uint8_t crc_sum_{0};
+  uint8_t last_char_{0};
+  uint8_t prev_char_{0};
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  const BinaryTag *binary_tags_{nullptr};
+  size_t binary_tag_count_{0};
+  /* The frame in progress, or the last one, is a binary one */
+  bool binary_frame_{false};
+  uint8_t binary_groups_[MAX_BINARY_GROUPS * BINARY_GROUP_SIZE]{};
+  /* Bytes of the groups, or of the CRC, to receive, and bytes received */
+  uint16_t binary_len_{0};
+  uint16_t binary_pos_{0};
+  uint16_t binary_crc_{0};
+  uint16_t binary_received_crc_{0};
+#endif
+
+  void start_group_();
+  void add_group_char_(uint8_t c);
+  void add_group_run_(const uint8_t *data, size_t len, uint8_t sum);
+  void end_group_();
+  void end_frame_(bool complete);
+  void resync_frame_();
+  bool check_crc_();
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  void parse_binary_char_(uint8_t c);
+  void end_binary_frame_();
+  const BinaryTag *find_binary_tag_(uint8_t id) const;
+#endif
+};
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
@@ -0,0 +1,11 @@
+#include "mk2pvrouter_profile.h"
+
+#ifdef MK2PVROUTER_PROFILE
+namespace esphome {
+namespace mk2pvrouter {
+
+Profiler profiler;
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
+#endif
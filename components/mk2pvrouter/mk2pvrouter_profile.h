@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+ * Cycle histograms of the processing phases of the hub, when built with MK2PVROUTER_PROFILE.
+ *
+ * Without it, the profiling scopes expand to nothing.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef MK2PVROUTER_PROFILE
+namespace esphome {
+namespace mk2pvrouter {
+
+/**
+ * @brief Measured phases. Scopes nest: the parsing of a chunk includes its CRC checks and groups,
+ * and a group includes the values published right away.
+ */
+enum class ProfilePhase : uint8_t {
+  /* Reading a chunk from the UART or the reader task ring */
+  READ,
+  /* Feeding a chunk to the parser */
+  PARSE,
+  /* Checking the CRC of a group */
+  CRC,
+  /* Looking up and storing a valid group */
+  GROUP,
+  /* Publishing a value to its listeners */
+  PUBLISH,
+};
+static const size_t PROFILE_PHASES = 5;
+/* Bucket n counts the durations of [2^n, 2^(n+1)) cycles, the first one 0 too and the last one the longer ones */
+static const size_t PROFILE_BUCKETS = 24;
+
+struct PhaseHistogram {
+  uint32_t count;
+  uint32_t max;
+  uint64_t total;
+  uint32_t buckets[PROFILE_BUCKETS];
+};
+
+/**
+ * @brief CPU cycle counter, provided by the hub.
+ */
+uint32_t profile_cycles();
+
+class Profiler {
+ public:
+  void add(ProfilePhase phase, uint32_t cycles) {
+    auto &histogram = histograms_[static_cast<size_t>(phase)];
+    const size_t bucket = cycles ? std::min<size_t>(31 - __builtin_clz(cycles), PROFILE_BUCKETS - 1) : 0;
+
+    histogram.count++;
+    histogram.total += cycles;
+    if (cycles > histogram.max)
+      histogram.max = cycles;
+    histogram.buckets[bucket]++;
+  }
+  const PhaseHistogram &get(ProfilePhase phase) const { return histograms_[static_cast<size_t>(phase)]; }
+  void reset() {
+    for (auto &histogram : histograms_)
+      histogram = PhaseHistogram{};
+  }
+
+ protected:
+  PhaseHistogram histograms_[PROFILE_PHASES]{};
+};
+
+/* Shared by the hubs, which run in the main loop task */
+extern Profiler profiler;
+
+/**
+ * @brief Adds the cycles spent by the enclosing scope to its phase.
+ */
+class ProfileScope {
+ public:
+  explicit ProfileScope(ProfilePhase phase) : phase_(phase), start_(profile_cycles()) {}
+  ~ProfileScope() { profiler.add(phase_, profile_cycles() - start_); }
+
+ protected:
+  ProfilePhase phase_;
+  uint32_t start_;
+};
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
+
+#define MK2PVROUTER_PROFILE_SCOPE(phase) ::esphome::mk2pvrouter::ProfileScope profile_scope_(phase)
+#else
+#define MK2PVROUTER_PROFILE_SCOPE(phase)
+#endif
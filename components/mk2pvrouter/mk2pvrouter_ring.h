@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * Lock-free byte ring shared by the UART reader task and loop().
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace mk2pvrouter {
+
+/**
+ * @class SpscRing
+ * @brief Byte ring with a single producer and a single consumer, which can run in different tasks.
+ *
+ * Head and tail are free running, so the ring can be completely filled, and each one is only
+ * written by its own side: the producer publishes its bytes with a release store of the head,
+ * and the consumer frees them with a release store of the tail.
+ *
+ * @tparam N Capacity in bytes, a power of two.
+ */
+template<size_t N> class SpscRing {
+  static_assert(N && !(N & (N - 1)), "The capacity of the ring must be a power of two");
+
+ public:
+  /**
+   * @brief Adds bytes to the ring. Producer side only.
+   *
+   * @param data The bytes to add.
+   * @param len Number of bytes.
+   * @return size_t Number of bytes added, less than len when the ring is full.
+   */
+  size_t push(const uint8_t *data, size_t len) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t room = N - (head - tail_.load(std::memory_order_acquire));
+
+    if (len > room)
+      len = room;
+    for (size_t i = 0; i < len; i++)
+      buf_[(head + i) & (N - 1)] = data[i];
+    head_.store(head + len, std::memory_order_release);
+    return len;
+  }
+
+  /**
+   * @brief Removes bytes from the ring. Consumer side only.
+   *
+   * @param data Where to copy the removed bytes.
+   * @param len Largest number of bytes to remove.
+   * @return size_t Number of bytes removed.
+   */
+  size_t pop(uint8_t *data, size_t len) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t used = head_.load(std::memory_order_acquire) - tail;
+
+    if (len > used)
+      len = used;
+    for (size_t i = 0; i < len; i++)
+      data[i] = buf_[(tail + i) & (N - 1)];
+    tail_.store(tail + len, std::memory_order_release);
+    return len;
+  }
+
+  /**
+   * @brief Drops every byte in the ring. Consumer side only.
+   */
+  void discard() { tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release); }
+
+  /**
+   * @brief Number of bytes in the ring. Exact on the consumer side, a lower bound elsewhere.
+   */
+  size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+
+ protected:
+  uint8_t buf_[N];
+  std::atomic<size_t> head_{0};
+  std::atomic<size_t> tail_{0};
+};
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
@@ -0,0 +1,255 @@
+#include "mk2pvrouter_stream.h"
+
+#ifdef USE_MK2PVROUTER_STREAM
+#include "esphome/core/hal.h"
+#include "esphome/core/log.h"
+#include "mk2pvrouter_parser.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+
+namespace esphome {
+namespace mk2pvrouter {
+
+static const char *const TAG = "mk2pvrouter.stream";
+
+/* Frames larger than this many MTU are not forwarded */
+constexpr size_t MAX_FRAME_MTUS = 4;
+/* Delay between two attempts to open the socket (ms) */
+constexpr uint32_t RECONNECT_INTERVAL = 5000;
+
+/**
+ * @brief Adds a tag to the forwarded ones. Every group is forwarded until a tag is added.
+ *
+ * @param tag The tag.
+ */
+void StreamSink::add_tag(const std::string &tag) { tags_.push_back(SelectedTag{hash_tag(tag.c_str(), tag.size()), tag}); }
+
+/**
+ * @brief Tells whether the groups of a tag are forwarded.
+ *
+ * @param tag The tag, NUL terminated.
+ * @param tag_hash The hash of the tag.
+ * @return true If no tag is selected, or the tag is one of them.
+ */
+bool StreamSink::selects(const char *tag, uint32_t tag_hash) const {
+  if (tags_.empty())
+    return true;
+  for (const auto &selected : tags_) {
+    if (selected.hash == tag_hash && selected.tag == tag)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Allocates the frame buffers of the input lines and the outgoing packet.
+ *
+ * @param lines Number of input lines of the hub.
+ */
+void StreamSink::setup(size_t lines) {
+  frames_.assign(lines, LineFrame{});
+  for (auto &frame : frames_)
+    frame.data.reserve(mtu_);
+  packet_.reserve(mtu_);
+}
+
+/**
+ * @brief Opens the socket once the network is up, or reopens it after an error, and flushes the
+ * packet once its flush interval elapsed.
+ */
+void StreamSink::loop() {
+  if (socket_ == nullptr)
+    connect_();
+  if (packet_frames_ && millis() - packet_start_ >= flush_interval_)
+    flush_();
+}
+
+void StreamSink::dump_config() {
+  ESP_LOGCONFIG(TAG, "  Stream: %s %s:%u", protocol_ == StreamProtocol::TCP ? "TCP" : "UDP", address_.c_str(), port_);
+  ESP_LOGCONFIG(TAG, "    MTU: %u", mtu_);
+  ESP_LOGCONFIG(TAG, "    Flush interval: %" PRIu32 "ms", flush_interval_);
+  if (!tags_.empty())
+    ESP_LOGCONFIG(TAG, "    Forwarded tags: %u", static_cast<unsigned>(tags_.size()));
+  ESP_LOGCONFIG(TAG, "    Frames sent: %" PRIu32 ", dropped: %" PRIu32, sent_frames_, dropped_frames_);
+}
+
+/**
+ * @brief Starts the frame of an input line with its start frame (0x2).
+ */
+void StreamSink::begin_frame(uint8_t line) {
+  auto &frame = frames_[line];
+
+  frame.data.clear();
+  frame.data.push_back(0x02);
+  frame.valid = true;
+}
+
+/**
+ * @brief Adds a validated group to the frame of an input line, as it was received.
+ *
+ * @param line Index of the input line.
+ * @param tag The tag, NUL terminated.
+ * @param tag_hash The hash of the tag.
+ * @param val The value.
+ * @param val_len Length of the value.
+ * @param crc The checksum character of the group.
+ */
+void StreamSink::add_group(uint8_t line, const char *tag, uint32_t tag_hash, const char *val, size_t val_len,
+                           uint16_t crc) {
+  auto &frame = frames_[line];
+
+  if (!frame.valid || !selects(tag, tag_hash))
+    return;
+  const size_t tag_len = strlen(tag);
+  /* 0xa | Tag | 0x9 | Data | 0x9 | CRC | 0xd, and room for the end frame */
+  if (frame.data.size() + tag_len + val_len + 6 > MAX_FRAME_MTUS * mtu_) {
+    frame.valid = false;
+    frame.data.clear();
+    return;
+  }
+  frame.data.push_back(0x0a);
+  frame.data.insert(frame.data.end(), tag, tag + tag_len);
+  frame.data.push_back(0x09);
+  frame.data.insert(frame.data.end(), val, val + val_len);
+  frame.data.push_back(0x09);
+  frame.data.push_back(static_cast<uint8_t>(crc));
+  frame.data.push_back(0x0d);
+}
+
+/**
+ * @brief Ends the frame of an input line and adds it to the outgoing packet, unless it is incomplete.
+ *
+ * @details A frame that does not fit in the room left in the packet flushes it first. A frame
+ * larger than the MTU is sent right away, split into MTU sized packets.
+ *
+ * @param line Index of the input line.
+ * @param complete false If the frame ended in the middle of a group, or was cut by a start frame.
+ */
+void StreamSink::end_frame(uint8_t line, bool complete) {
+  auto &frame = frames_[line];
+
+  if (complete && !frame.valid)
+    dropped_frames_++;
+  if (!complete || !frame.valid) {
+    frame.data.clear();
+    frame.valid = false;
+    return;
+  }
+  frame.data.push_back(0x03);
+  frame.valid = false;
+
+  if (packet_.size() + frame.data.size() > mtu_)
+    flush_();
+  if (frame.data.size() > mtu_) {
+    bool sent = true;
+    for (size_t i = 0; i < frame.data.size(); i += mtu_)
+      sent &= send_(frame.data.data() + i, std::min<size_t>(mtu_, frame.data.size() - i));
+    if (sent)
+      sent_frames_++;
+    else
+      dropped_frames_++;
+  } else {
+    if (!packet_frames_)
+      packet_start_ = millis();
+    packet_.insert(packet_.end(), frame.data.begin(), frame.data.end());
+    packet_frames_++;
+    if (!flush_interval_)
+      flush_();
+  }
+  frame.data.clear();
+}
+
+/**
+ * @brief Opens the socket, at most once per RECONNECT_INTERVAL.
+ *
+ * @return false If the socket is not open.
+ */
+bool StreamSink::connect_() {
+  const uint32_t now = millis();
+
+  if (socket_ != nullptr)
+    return true;
+  if (last_connect_ && now - last_connect_ < RECONNECT_INTERVAL)
+    return false;
+  /* 0 means never tried */
+  last_connect_ = now ? now : 1;
+
+  addr_len_ = socket::set_sockaddr(reinterpret_cast<struct sockaddr *>(&addr_), sizeof(addr_), address_, port_);
+  if (!addr_len_) {
+    ESP_LOGE(TAG, "Invalid stream address %s", address_.c_str());
+    return false;
+  }
+  if (protocol_ == StreamProtocol::TCP)
+    socket_ = socket::socket_ip(SOCK_STREAM, IPPROTO_TCP);
+  else
+    socket_ = socket::socket_ip(SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_ == nullptr) {
+    ESP_LOGW(TAG, "Could not create the stream socket, errno %d", errno);
+    return false;
+  }
+  socket_->setblocking(false);
+  if (protocol_ == StreamProtocol::TCP &&
+      socket_->connect(reinterpret_cast<struct sockaddr *>(&addr_), addr_len_) < 0 && errno != EINPROGRESS) {
+    ESP_LOGW(TAG, "Could not connect to %s:%u, errno %d", address_.c_str(), port_, errno);
+    close_();
+    return false;
+  }
+  return true;
+}
+
+void StreamSink::close_() {
+  if (socket_ == nullptr)
+    return;
+  socket_->close();
+  socket_ = nullptr;
+}
+
+/**
+ * @brief Sends the outgoing packet, or drops its frames when it cannot be sent.
+ */
+void StreamSink::flush_() {
+  if (!packet_frames_)
+    return;
+  if (send_(packet_.data(), packet_.size()))
+    sent_frames_ += packet_frames_;
+  else
+    dropped_frames_ += packet_frames_;
+  packet_.clear();
+  packet_frames_ = 0;
+}
+
+/**
+ * @brief Sends a packet without blocking.
+ *
+ * @details Nothing is queued: a packet the socket cannot take right away, for instance while the
+ * TCP connection is being established, is dropped. A TCP connection that fails, or only takes part
+ * of a packet, is closed and reopened later, the collector resynchronizing on the next start frame.
+ *
+ * @return false If the packet was not sent.
+ */
+bool StreamSink::send_(const uint8_t *data, size_t len) {
+  if (!connect_())
+    return false;
+  ssize_t sent;
+  if (protocol_ == StreamProtocol::TCP)
+    sent = socket_->write(data, len);
+  else
+    sent = socket_->sendto(data, len, 0, reinterpret_cast<struct sockaddr *>(&addr_), addr_len_);
+  if (sent == static_cast<ssize_t>(len))
+    return true;
+  if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS || errno == ENOTCONN))
+    return false;
+  if (protocol_ == StreamProtocol::TCP) {
+    ESP_LOGW(TAG, "Stream connection lost, errno %d", errno);
+    close_();
+  }
+  return false;
+}
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
+
+#endif
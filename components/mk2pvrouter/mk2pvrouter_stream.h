@@ -0,0 +1,99 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#ifdef USE_MK2PVROUTER_STREAM
+#include "esphome/components/socket/socket.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace esphome {
+namespace mk2pvrouter {
+
+enum class StreamProtocol : uint8_t {
+  UDP,
+  TCP,
+};
+
+/**
+ * @class StreamSink
+ * @brief Forwards the validated frames of a hub, as received, to a collector over UDP or TCP.
+ *
+ * Each frame is rebuilt in a buffer of its input line as its groups are validated, then added to
+ * the outgoing packet once complete. Packets are sent when the next frame does not fit in the MTU,
+ * or once the flush interval elapsed since their first frame.
+ */
+class StreamSink {
+ public:
+  void set_protocol(StreamProtocol protocol) { protocol_ = protocol; }
+  void set_address(const std::string &address, uint16_t port) {
+    address_ = address;
+    port_ = port;
+  }
+  void set_mtu(uint16_t mtu) { mtu_ = mtu; }
+  void set_flush_interval(uint32_t flush_interval) { flush_interval_ = flush_interval; }
+  /**
+   * @brief Only forwards the groups of this tag, and of the other added ones.
+   */
+  void add_tag(const std::string &tag);
+  /**
+   * @brief Tells whether every group is forwarded, so that the parser must not skip any of them.
+   */
+  bool forwards_all() const { return tags_.empty(); }
+  bool selects(const char *tag, uint32_t tag_hash) const;
+
+  void setup(size_t lines);
+  void loop();
+  void dump_config();
+
+  void begin_frame(uint8_t line);
+  void add_group(uint8_t line, const char *tag, uint32_t tag_hash, const char *val, size_t val_len, uint16_t crc);
+  void end_frame(uint8_t line, bool complete);
+
+ protected:
+  struct SelectedTag {
+    uint32_t hash;
+    std::string tag;
+  };
+  /**
+   * @brief Frame in progress of an input line.
+   */
+  struct LineFrame {
+    std::vector<uint8_t> data;
+    /* Cleared when the frame does not fit, it is then dropped */
+    bool valid;
+  };
+
+  StreamProtocol protocol_{StreamProtocol::UDP};
+  std::string address_;
+  uint16_t port_{0};
+  uint16_t mtu_{1400};
+  uint32_t flush_interval_{1000};
+  std::vector<SelectedTag> tags_{};
+
+  std::vector<LineFrame> frames_{};
+  std::vector<uint8_t> packet_{};
+  uint16_t packet_frames_{0};
+  /* Time when the first frame of the packet was added (ms) */
+  uint32_t packet_start_{0};
+
+  std::unique_ptr<socket::Socket> socket_{nullptr};
+  struct sockaddr_storage addr_ {};
+  socklen_t addr_len_{0};
+  uint32_t last_connect_{0};
+
+  uint32_t sent_frames_{0};
+  uint32_t dropped_frames_{0};
+
+  bool connect_();
+  void close_();
+  void flush_();
+  bool send_(const uint8_t *data, size_t len);
+};
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
+
+#endif
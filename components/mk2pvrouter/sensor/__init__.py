@@ -1,22 +1,189 @@
 import esphome.codegen as cg
 from esphome.components import sensor
-from esphome.const import CONF_ID, ICON_FLASH, UNIT_WATT_HOURS
+import esphome.config_validation as cv
+from esphome.const import (
+    CONF_ID,
+    CONF_TYPE,
+    DEVICE_CLASS_ENERGY,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    ICON_FLASH,
+    STATE_CLASS_MEASUREMENT,
+    STATE_CLASS_TOTAL_INCREASING,
+    UNIT_WATT_HOURS,
+)
 
-from .. import CONF_TAG_NAME, CONF_MK2PVROUTER_ID, MK2PVROUTER_LISTENER_SCHEMA, mk2pvrouter_ns
+from .. import (
+    CONF_LAZY,
+    CONF_TAG_NAME,
+    CONF_MK2PVROUTER_ID,
+    MK2PVROUTER_LISTENER_SCHEMA,
+    Mk2PVRouter,
+    expand_indexes,
+    indexed_listener_schema,
+    mk2pvrouter_ns,
+    register_mk2pvrouter_listener,
+    validate_indexes,
+    validate_lazy,
+)
+
+MAX_DECIMALS = 6
 
 Mk2PVRouterSensor = mk2pvrouter_ns.class_("Mk2PVRouterSensor", sensor.Sensor, cg.Component)
+Mk2PVRouterEnergySensor = mk2pvrouter_ns.class_("Mk2PVRouterEnergySensor", Mk2PVRouterSensor)
+
+CONF_DEADBAND = "deadband"
+CONF_DECIMALS = "decimals"
+CONF_SAVE_THRESHOLD = "save_threshold"
+CONF_SAVE_INTERVAL = "save_interval"
+CONF_MAX_GAP = "max_gap"
+CONF_INVERT = "invert"
+
+TYPE_TAG = "tag"
+TYPE_STATISTICS = "statistics"
+TYPE_ENERGY = "energy"
+
+UNIT_MICROSECOND = "µs"
+ICON_COUNTER = "mdi:counter"
+ICON_TIMER = "mdi:timer-outline"
+
+# Hub counters, published on each update
+STATISTICS_COUNTERS = [
+    "frames_received",
+    "groups_parsed",
+    "crc_errors",
+    "invalid_tags",
+    "invalid_values",
+    "overflows",
+    "dropped_frames",
+    "skipped_frames",
+    "lost_bytes",
+]
+# Frame parsing times since the previous update
+STATISTICS_TIMES = [
+    "frame_time_min",
+    "frame_time_mean",
+    "frame_time_max",
+]
+
+
+def validate_deadband(value):
+    """Accept an absolute deadband (5) or a percentage of the last value (5%)."""
+    if isinstance(value, str) and value.endswith("%"):
+        return {"value": cv.positive_float(value[:-1]) / 100.0, "percentage": True}
+    return {"value": cv.positive_float(value), "percentage": False}
+
+
+TAG_SCHEMA = indexed_listener_schema(
+    cv.All(
+        sensor.sensor_schema(
+            Mk2PVRouterSensor,
+            unit_of_measurement=UNIT_WATT_HOURS,
+            icon=ICON_FLASH,
+            accuracy_decimals=0,
+        )
+        .extend(MK2PVROUTER_LISTENER_SCHEMA)
+        .extend(
+            {
+                cv.Optional(CONF_DECIMALS, default=0): cv.int_range(min=0, max=MAX_DECIMALS),
+                cv.Optional(CONF_DEADBAND): validate_deadband,
+                # Never published, and internal: the value is decoded when a lambda reads it with get_value()
+                cv.Optional(CONF_LAZY, default=False): cv.boolean,
+            }
+        ),
+        validate_indexes,
+        validate_lazy,
+    )
+)
 
-CONFIG_SCHEMA = sensor.sensor_schema(
-    Mk2PVRouterSensor,
-    unit_of_measurement=UNIT_WATT_HOURS,
-    icon=ICON_FLASH,
-    accuracy_decimals=0,
-).extend(MK2PVROUTER_LISTENER_SCHEMA)
+# Integrates a power tag (W) into an energy (Wh) saved to flash
+ENERGY_SCHEMA = indexed_listener_schema(
+    cv.All(
+        sensor.sensor_schema(
+            Mk2PVRouterEnergySensor,
+            unit_of_measurement=UNIT_WATT_HOURS,
+            icon=ICON_FLASH,
+            accuracy_decimals=0,
+            device_class=DEVICE_CLASS_ENERGY,
+            state_class=STATE_CLASS_TOTAL_INCREASING,
+        )
+        .extend(MK2PVROUTER_LISTENER_SCHEMA)
+        .extend(
+            {
+                cv.Optional(CONF_DECIMALS, default=0): cv.int_range(min=0, max=MAX_DECIMALS),
+                cv.Optional(CONF_DEADBAND): validate_deadband,
+                cv.Optional(CONF_SAVE_THRESHOLD, default=10.0): cv.positive_float,
+                cv.Optional(CONF_SAVE_INTERVAL, default="10min"): cv.positive_time_period_milliseconds,
+                cv.Optional(CONF_MAX_GAP, default="60s"): cv.positive_time_period_milliseconds,
+                cv.Optional(CONF_INVERT, default=False): cv.boolean,
+            }
+        ),
+        validate_indexes,
+    )
+)
+
+STATISTICS_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_MK2PVROUTER_ID): cv.use_id(Mk2PVRouter),
+        **{
+            cv.Optional(counter): sensor.sensor_schema(
+                icon=ICON_COUNTER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for counter in STATISTICS_COUNTERS
+        },
+        **{
+            cv.Optional(time): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MICROSECOND,
+                icon=ICON_TIMER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for time in STATISTICS_TIMES
+        },
+    }
+)
+
+CONFIG_SCHEMA = cv.typed_schema(
+    {
+        TYPE_TAG: TAG_SCHEMA,
+        TYPE_STATISTICS: STATISTICS_SCHEMA,
+        TYPE_ENERGY: ENERGY_SCHEMA,
+    },
+    lower=True,
+    default_type=TYPE_TAG,
+)
 
 
 async def to_code(config):
+    mk2pvrouter = await cg.get_variable(config[CONF_MK2PVROUTER_ID])
+
+    if config[CONF_TYPE] == TYPE_STATISTICS:
+        for key in STATISTICS_COUNTERS + STATISTICS_TIMES:
+            if key in config:
+                sens = await sensor.new_sensor(config[key])
+                cg.add(getattr(mk2pvrouter, f"set_{key}_sensor")(sens))
+        return
+
+    for conf in expand_indexes(config):
+        await _register_tag_sensor(conf)
+
+
+async def _register_tag_sensor(config):
     var = cg.new_Pvariable(config[CONF_ID], config[CONF_TAG_NAME])
     await cg.register_component(var, config)
     await sensor.register_sensor(var, config)
-    mk2pvrouter = await cg.get_variable(config[CONF_MK2PVROUTER_ID])
-    cg.add(mk2pvrouter.register_mk2pvrouter_listener(var))
+    await register_mk2pvrouter_listener(var, config)
+    cg.add(var.set_decimals(config[CONF_DECIMALS]))
+    if CONF_DEADBAND in config:
+        deadband = config[CONF_DEADBAND]
+        cg.add(var.set_deadband(deadband["value"], deadband["percentage"]))
+    if config.get(CONF_LAZY, False):
+        cg.add(var.set_lazy(True))
+    if config[CONF_TYPE] == TYPE_ENERGY:
+        cg.add(var.set_save_threshold(config[CONF_SAVE_THRESHOLD]))
+        cg.add(var.set_save_interval(config[CONF_SAVE_INTERVAL]))
+        cg.add(var.set_max_gap(config[CONF_MAX_GAP]))
+        cg.add(var.set_invert(config[CONF_INVERT]))
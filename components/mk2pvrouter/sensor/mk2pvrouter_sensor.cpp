@@ -1,13 +1,126 @@
 #include "esphome/core/log.h"
 #include "mk2pvrouter_sensor.h"
+
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+
 namespace esphome {
 namespace mk2pvrouter {
 static const char *const TAG = "mk2pvrouter_sensor";
 Mk2PVRouterSensor::Mk2PVRouterSensor(const char *tag) { this->tag = std::string(tag); }
-void Mk2PVRouterSensor::publish_val(const std::string &val) {
-  auto newval = parse_number<float>(val).value_or(0.0f);
-  publish_state(newval);
+void Mk2PVRouterSensor::publish_val(const std::string &val) { publish_raw(val.c_str(), val.size()); }
+void Mk2PVRouterSensor::publish_raw(const char *val, size_t len) {
+  float newval;
+
+  /* Longer values do not get through the parser */
+  if (lazy_ && len < MAX_VAL_SIZE) {
+    memcpy(raw_, val, len);
+    raw_len_ = len;
+    raw_pending_ = true;
+    return;
+  }
+  if (!decode_val(val, len, &newval)) {
+    if (hub_ != nullptr)
+      hub_->report_invalid_value(tag.c_str(), val);
+    return;
+  }
+  publish_number(newval);
+}
+bool Mk2PVRouterSensor::decode_val(const char *val, size_t len, float *out) {
+  return decode_fixed_point(val, len, decimals_, out);
+}
+void Mk2PVRouterSensor::publish_number(float val) {
+  /* Aggregated by the hub, already decoded */
+  if (lazy_) {
+    value_ = val;
+    raw_pending_ = false;
+    return;
+  }
+  if (deadband_ > 0.0f && !std::isnan(last_published_)) {
+    const float deadband = deadband_percentage_ ? std::fabs(last_published_) * deadband_ : deadband_;
+    if (std::fabs(val - last_published_) < deadband)
+      return;
+  }
+  last_published_ = val;
+  publish_state(val);
+}
+void Mk2PVRouterEnergySensor::setup() {
+  pref_ = global_preferences->make_preference<uint64_t>(get_object_id_hash());
+  if (pref_.load(&energy_))
+    ESP_LOGD(TAG, "Restored energy %.1f Wh for tag %s", static_cast<float>(energy_) / MW_MS_PER_WH, tag.c_str());
+  saved_energy_ = energy_;
+  last_save_ = millis();
+  Mk2PVRouterSensor::publish_number(static_cast<float>(energy_) / MW_MS_PER_WH);
+}
+void Mk2PVRouterEnergySensor::on_shutdown() {
+  if (energy_ != saved_energy_)
+    save_();
+}
+void Mk2PVRouterEnergySensor::publish_number(float val) {
+  const uint32_t now = millis();
+  const float power = invert_ ? -val : val;
+
+  /* The previous power is held until this value, a gap is not integrated */
+  if (last_time_ && now - last_time_ <= max_gap_)
+    energy_ += last_power_ * (now - last_time_);
+  last_power_ = power > 0.0f ? std::llround(power * 1000.0f) : 0;
+  last_time_ = now ? now : 1;
+
+  if (energy_ - saved_energy_ >= save_threshold_ ||
+      (energy_ != saved_energy_ && now - last_save_ >= save_interval_))
+    save_();
+  Mk2PVRouterSensor::publish_number(static_cast<float>(energy_) / MW_MS_PER_WH);
+}
+/* The energy stays valid, but the last power is not integrated over the link loss */
+void Mk2PVRouterEnergySensor::publish_stale() { last_time_ = 0; }
+void Mk2PVRouterEnergySensor::save_() {
+  pref_.save(&energy_);
+  saved_energy_ = energy_;
+  last_save_ = millis();
+}
+void Mk2PVRouterEnergySensor::dump_config() {
+  Mk2PVRouterSensor::dump_config();
+  ESP_LOGCONFIG(TAG, "  Integrates: %s power", invert_ ? "negative" : "positive");
+  ESP_LOGCONFIG(TAG, "  Save every: %.1f Wh or %" PRIu32 "s", static_cast<float>(save_threshold_) / MW_MS_PER_WH,
+                save_interval_ / 1000);
+}
+/**
+ * @brief The last value of the tag, decoded on the first call after it is received when lazy.
+ * 
+ * @details A lazy sensor never publishes: the sensors that are only read by lambdas skip the decoding
+ * and the callbacks of the values nobody reads.
+ * 
+ * @return float The value, NAN until one is received, or the state of a sensor that is not lazy.
+ */
+float Mk2PVRouterSensor::get_value() {
+  if (!lazy_)
+    return get_state();
+  if (raw_pending_) {
+    raw_pending_ = false;
+    if (!decode_val(raw_, raw_len_, &value_))
+      value_ = NAN;
+  }
+  return value_;
+}
+/* NAN shows the sensor as unavailable, and the next value is published whatever the deadband */
+void Mk2PVRouterSensor::publish_stale() {
+  raw_pending_ = false;
+  value_ = NAN;
+  if (lazy_)
+    return;
+  last_published_ = NAN;
+  publish_state(NAN);
+}
+void Mk2PVRouterSensor::dump_config() {
+  LOG_SENSOR("  ", "Mk2PVRouter Sensor", this);
+  if (decimals_)
+    ESP_LOGCONFIG(TAG, "  Decimals: %u", decimals_);
+  if (lazy_)
+    ESP_LOGCONFIG(TAG, "  Lazy: YES");
+  if (deadband_ > 0.0f)
+    ESP_LOGCONFIG(TAG, "  Deadband: %.3f%s", deadband_percentage_ ? deadband_ * 100.0f : deadband_,
+                  deadband_percentage_ ? "%" : "");
 }
-void Mk2PVRouterSensor::dump_config() { LOG_SENSOR("  ", "Mk2PVRouter Sensor", this); }
 }  // namespace mk2pvrouter
 }  // namespace esphome
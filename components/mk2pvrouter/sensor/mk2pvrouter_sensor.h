@@ -2,6 +2,9 @@
 
 #include "esphome/components/mk2pvrouter/mk2pvrouter.h"
 #include "esphome/components/sensor/sensor.h"
+#include "esphome/core/preferences.h"
+
+#include <cmath>
 
 namespace esphome {
 namespace mk2pvrouter {
@@ -9,7 +12,78 @@ class Mk2PVRouterSensor : public Mk2PVRouterListener, public sensor::Sensor, pub
  public:
   Mk2PVRouterSensor(const char *tag);
   void publish_val(const std::string &val) override;
+  void publish_raw(const char *val, size_t len) override;
+  bool decode_val(const char *val, size_t len, float *out) override;
+  void publish_number(float val) override;
+  void publish_stale() override;
+  void dump_config() override;
+  void set_decimals(uint8_t decimals) { decimals_ = decimals; }
+  void set_deadband(float deadband, bool percentage) {
+    deadband_ = deadband;
+    deadband_percentage_ = percentage;
+  }
+  /* Only keep the raw value, decoded by get_value() instead of being published */
+  void set_lazy(bool lazy) { lazy_ = lazy; }
+  float get_value();
+
+ protected:
+  /* Implied decimals of the raw values */
+  uint8_t decimals_{0};
+  /* Minimal change from the last published value for a new value to be published */
+  float deadband_{0.0f};
+  bool deadband_percentage_{false};
+  float last_published_{NAN};
+  /* Last raw value when lazy, not decoded yet when pending, and the value it decoded to */
+  bool lazy_{false};
+  char raw_[MAX_VAL_SIZE]{};
+  uint8_t raw_len_{0};
+  bool raw_pending_{false};
+  float value_{NAN};
+};
+
+/**
+ * @class Mk2PVRouterEnergySensor
+ * @brief Integrates the power (W) of a tag into an energy (Wh), kept across reboots.
+ * 
+ * The energy is accumulated in mW.ms, an integer, and saved to the preferences at most every
+ * save_threshold of energy or every save_interval, to spare the flash.
+ */
+class Mk2PVRouterEnergySensor : public Mk2PVRouterSensor {
+ public:
+  Mk2PVRouterEnergySensor(const char *tag) : Mk2PVRouterSensor(tag) {}
+  void setup() override;
+  void on_shutdown() override;
+  void publish_number(float val) override;
+  void publish_stale() override;
+  /* An unchanged power is integrated too */
+  bool needs_every_value() const override { return true; }
   void dump_config() override;
+  /* Energy (Wh) and time (ms) between two saves, whichever comes first */
+  void set_save_threshold(float save_threshold) { save_threshold_ = save_threshold * MW_MS_PER_WH; }
+  void set_save_interval(uint32_t save_interval) { save_interval_ = save_interval; }
+  /* Longest interval between two values (ms) that is integrated, the longer ones are gaps */
+  void set_max_gap(uint32_t max_gap) { max_gap_ = max_gap; }
+  /* Integrate the negative part of the power, such as the exported one, instead of the positive part */
+  void set_invert(bool invert) { invert_ = invert; }
+
+ protected:
+  static constexpr uint64_t MW_MS_PER_WH = 3600ULL * 1000 * 1000;
+
+  uint64_t save_threshold_{10 * MW_MS_PER_WH};
+  uint32_t save_interval_{600000};
+  uint32_t max_gap_{60000};
+  bool invert_{false};
+
+  ESPPreferenceObject pref_;
+  /* Energy (mW.ms), and the last saved one */
+  uint64_t energy_{0};
+  uint64_t saved_energy_{0};
+  uint32_t last_save_{0};
+  /* Last power (mW), held until the next value, and its time (ms, 0 before the first one) */
+  int64_t last_power_{0};
+  uint32_t last_time_{0};
+
+  void save_();
 };
 
 }  // namespace mk2pvrouter
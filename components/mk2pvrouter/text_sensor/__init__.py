@@ -1,21 +1,50 @@
 import esphome.codegen as cg
 from esphome.components import text_sensor
+import esphome.config_validation as cv
 from esphome.const import CONF_ID
 
-from .. import CONF_TAG_NAME, CONF_MK2PVROUTER_ID, MK2PVROUTER_LISTENER_SCHEMA, mk2pvrouter_ns
+from .. import (
+    CONF_LAZY,
+    CONF_TAG_NAME,
+    MK2PVROUTER_LISTENER_SCHEMA,
+    expand_indexes,
+    indexed_listener_schema,
+    mk2pvrouter_ns,
+    register_mk2pvrouter_listener,
+    validate_indexes,
+    validate_lazy,
+)
 
 Mk2PVRouterTextSensor = mk2pvrouter_ns.class_(
     "Mk2PVRouterTextSensor", text_sensor.TextSensor, cg.Component
 )
 
-CONFIG_SCHEMA = text_sensor.text_sensor_schema(Mk2PVRouterTextSensor).extend(
-    MK2PVROUTER_LISTENER_SCHEMA
+
+CONFIG_SCHEMA = indexed_listener_schema(
+    cv.All(
+        text_sensor.text_sensor_schema(Mk2PVRouterTextSensor)
+        .extend(MK2PVROUTER_LISTENER_SCHEMA)
+        .extend(
+            {
+                # Never published, and internal: the string is built when a lambda reads it with get_value()
+                cv.Optional(CONF_LAZY, default=False): cv.boolean,
+            }
+        ),
+        validate_indexes,
+        validate_lazy,
+    )
 )
 
 
 async def to_code(config):
+    for conf in expand_indexes(config):
+        await _register_text_sensor(conf)
+
+
+async def _register_text_sensor(config):
     var = cg.new_Pvariable(config[CONF_ID], config[CONF_TAG_NAME])
     await cg.register_component(var, config)
     await text_sensor.register_text_sensor(var, config)
-    mk2pvrouter = await cg.get_variable(config[CONF_MK2PVROUTER_ID])
-    cg.add(mk2pvrouter.register_mk2pvrouter_listener(var))
+    await register_mk2pvrouter_listener(var, config)
+    if config[CONF_LAZY]:
+        cg.add(var.set_lazy(True))
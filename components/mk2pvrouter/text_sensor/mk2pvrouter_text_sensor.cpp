@@ -1,10 +1,44 @@
 #include "esphome/core/log.h"
 #include "mk2pvrouter_text_sensor.h"
+
+#include <cstring>
+
 namespace esphome {
 namespace mk2pvrouter {
 static const char *const TAG = "mk2pvrouter_text_sensor";
 Mk2PVRouterTextSensor::Mk2PVRouterTextSensor(const char *tag) { this->tag = std::string(tag); }
-void Mk2PVRouterTextSensor::publish_val(const std::string &val) { publish_state(val); }
+void Mk2PVRouterTextSensor::publish_val(const std::string &val) { publish_raw(val.c_str(), val.size()); }
+
+/**
+ * @brief Publishes a raw value, only when it differs from the last one published.
+ *
+ * @details The router status strings cycle through a few values, so the value is compared in place
+ * with a copy kept in the sensor, and the string of the state is only built for a new value.
+ */
+void Mk2PVRouterTextSensor::publish_raw(const char *val, size_t len) {
+  /* Longer values do not get through the parser */
+  if (len >= MAX_VAL_SIZE)
+    return;
+  if (last_len_ == len && len && !memcmp(last_, val, len))
+    return;
+  memcpy(last_, val, len);
+  last_len_ = len;
+  if (!lazy_)
+    publish_state(std::string(val, len));
+}
+
+/**
+ * @brief The last value of the tag, empty until one is received, or the state of a sensor that is not lazy.
+ */
+std::string Mk2PVRouterTextSensor::get_value() const {
+  if (!lazy_)
+    return state;
+  return std::string(last_, last_len_);
+}
+/**
+ * @brief A text has no unavailable state, so the last one is kept, but the next value is published even if unchanged.
+ */
+void Mk2PVRouterTextSensor::publish_stale() { last_len_ = 0; }
 void Mk2PVRouterTextSensor::dump_config() { LOG_TEXT_SENSOR("  ", "Mk2PVRouter Text Sensor", this); }
 }  // namespace mk2pvrouter
 }  // namespace esphome
@@ -8,7 +8,18 @@ class Mk2PVRouterTextSensor : public Mk2PVRouterListener, public text_sensor::Te
  public:
   Mk2PVRouterTextSensor(const char *tag);
   void publish_val(const std::string &val) override;
+  void publish_raw(const char *val, size_t len) override;
+  void publish_stale() override;
   void dump_config() override;
+  /* Only keep the raw value, turned into a string by get_value() instead of being published */
+  void set_lazy(bool lazy) { lazy_ = lazy; }
+  std::string get_value() const;
+
+ protected:
+  bool lazy_{false};
+  /* Last raw value published, or received when lazy, len is 0 until the first one */
+  char last_[MAX_VAL_SIZE]{};
+  uint8_t last_len_{0};
 };
 }  // namespace mk2pvrouter
 }  // namespace esphome
@@ -0,0 +1,116 @@
+#include "frames.h"
+
+#include <cstdint>
+
+namespace parser_host {
+
+static const char *const TYPICAL_GROUPS[][2] = {
+    {"P1", "1234"},   {"P2", "-567"},  {"P3", "89"},     {"D1", "1200"},   {"D2", "0"},      {"D3", "0"},
+    {"I1", "5.42"},   {"I2", "2.47"},  {"I3", "0.39"},   {"V1", "231.4"},  {"V2", "229.8"},  {"V3", "232.1"},
+    {"PF1", "0.97"},  {"PF2", "0.88"}, {"PF3", "0.51"},  {"E1", "123456"}, {"E2", "98765"},  {"E3", "4321"},
+    {"ED1", "45678"}, {"ED2", "0"},    {"ED3", "0"},     {"F", "50.02"},   {"T1", "21.5"},   {"T2", "48.0"},
+    {"L1", "1"},      {"L2", "0"},     {"L3", "0"},      {"M", "NORMAL"},  {"R", "OFF"},     {"OVR", "0"},
+    {"TIME", "1234567"},                 {"VER", "v2.3.1"},
+};
+static const size_t TYPICAL_GROUP_COUNT = sizeof(TYPICAL_GROUPS) / sizeof(TYPICAL_GROUPS[0]);
+
+std::string make_group(const std::string &tag, const std::string &val, bool historical) {
+  const std::string body = tag + "\t" + val + "\t";
+  uint8_t sum = 0;
+
+  for (unsigned char c : body)
+    sum += c;
+  if (historical)
+    sum -= '\t';
+  return "\n" + body + static_cast<char>((sum & 0x3f) + 0x20) + "\r";
+}
+
+const std::vector<std::string> &typical_tags() {
+  static const std::vector<std::string> tags = [] {
+    std::vector<std::string> tags;
+    for (const auto &group : TYPICAL_GROUPS)
+      tags.emplace_back(group[0]);
+    return tags;
+  }();
+  return tags;
+}
+
+std::string typical_frame(bool historical) {
+  std::string frame = "\x02";
+
+  for (const auto &group : TYPICAL_GROUPS)
+    frame += make_group(group[0], group[1], historical);
+  return frame + "\x03";
+}
+
+static std::string random_text(std::mt19937 &rng, size_t len, const char *chars) {
+  const size_t count = std::char_traits<char>::length(chars);
+  std::string text;
+
+  for (size_t i = 0; i < len; i++)
+    text += chars[rng() % count];
+  return text;
+}
+
+std::string random_frame(std::mt19937 &rng, bool historical) {
+  std::string frame = "\x02";
+  const size_t groups = rng() % 40;
+
+  for (size_t i = 0; i < groups; i++) {
+    std::string tag;
+    if (rng() % 4)
+      tag = TYPICAL_GROUPS[rng() % TYPICAL_GROUP_COUNT][0];
+    else
+      tag = random_text(rng, 1 + rng() % 20, "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_");
+    std::string val;
+    if (rng() % 4)
+      val = random_text(rng, 1 + rng() % 8, "-0123456789.");
+    else
+      val = random_text(rng, rng() % 24, " !#%+-./0123456789:ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz~");
+    frame += make_group(tag, val, historical);
+  }
+  return frame + "\x03";
+}
+
+std::string binary_frame(const std::vector<std::pair<uint8_t, int32_t>> &groups) {
+  std::string body(1, static_cast<char>(groups.size()));
+  uint16_t crc = 0xFFFF;
+
+  for (const auto &group : groups) {
+    const uint32_t value = static_cast<uint32_t>(group.second);
+    body += static_cast<char>(group.first);
+    for (int shift = 0; shift < 32; shift += 8)
+      body += static_cast<char>(value >> shift);
+  }
+  /* CRC-16/CCITT-FALSE of the count and the groups */
+  for (unsigned char c : body) {
+    crc ^= static_cast<uint16_t>(c) << 8;
+    for (int bit = 0; bit < 8; bit++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return "\x01" + body + static_cast<char>(crc & 0xFF) + static_cast<char>(crc >> 8);
+}
+
+std::string corrupt(std::string data, std::mt19937 &rng) {
+  static const char DELIMITERS[] = {'\x02', '\x03', '\n', '\t', '\r'};
+  const size_t changes = 1 + rng() % 3;
+
+  for (size_t i = 0; i < changes && !data.empty(); i++) {
+    const size_t pos = rng() % data.size();
+    const char c = rng() % 2 ? DELIMITERS[rng() % sizeof(DELIMITERS)] : static_cast<char>(rng());
+    switch (rng() % 3) {
+      case 0:
+        data[pos] = c;
+        break;
+      case 1:
+        data.insert(data.begin() + pos, c);
+        break;
+      default:
+        data.erase(pos, 1);
+        break;
+    }
+  }
+  return data;
+}
+
+}  // namespace parser_host
@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * Frames fed to the parser by the host test, benchmark and fuzzer.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace parser_host {
+
+/**
+ * @brief A group with its checksum: 0xa | Tag | 0x9 | Data | 0x9 | CRC | 0xd
+ */
+std::string make_group(const std::string &tag, const std::string &val, bool historical);
+/**
+ * @brief Tags of typical_frame(), the first ones being those the benchmark listens to.
+ */
+const std::vector<std::string> &typical_tags();
+/**
+ * @brief A valid frame with the 32 groups of a three-phase router.
+ */
+std::string typical_frame(bool historical);
+/**
+ * @brief A valid frame of random groups: tags of typical_frame() or random ones, some of them too
+ * long for the tag buffer, and values of random length and characters.
+ */
+std::string random_frame(std::mt19937 &rng, bool historical);
+/**
+ * @brief A binary frame of (tag ID, value) groups: 0x1 | Count | Count x (Tag ID | Value) | CRC
+ */
+std::string binary_frame(const std::vector<std::pair<uint8_t, int32_t>> &groups);
+/**
+ * @brief Replaces, inserts or deletes a few random bytes, the delimiters being more likely.
+ */
+std::string corrupt(std::string data, std::mt19937 &rng);
+
+}  // namespace parser_host
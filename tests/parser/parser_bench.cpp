@@ -0,0 +1,129 @@
+/*
+ * Host benchmark of the frame parser, in ns per byte and per group, with the word-at-a-time scan
+ * and byte-wise.
+ *
+ * Usage: parser_bench [capture...]
+ * Each capture is a file of raw bytes recorded from the router UART, benchmarked beside the
+ * built-in typical and random frames.
+ */
+
+#include "frames.h"
+#include "parser_driver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using parser_host::ReplayOptions;
+
+/* Bytes of each input, its frames being repeated or generated up to this size */
+static const size_t INPUT_SIZE = 1 << 20;
+/* Each case is timed this many times for at least MIN_SECONDS, keeping the fastest run */
+static const int RUNS = 5;
+static const double MIN_SECONDS = 0.05;
+/* Bytes fed per call, the READ_CHUNK_SIZE of the hub */
+static const size_t CHUNK_SIZE = 32;
+
+struct Input {
+  std::string name;
+  std::string data;
+};
+
+using CountGroups = size_t (*)(const uint8_t *, size_t, const ReplayOptions &);
+
+/**
+ * @brief Nanoseconds per byte of the parser on an input, and the groups it handed off per pass.
+ */
+static double measure(CountGroups count_groups, const std::string &data, const ReplayOptions &options,
+                      size_t *groups) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+  double best = 0;
+
+  for (int run = 0; run < RUNS; run++) {
+    size_t passes = 0;
+    double elapsed = 0;
+    const auto start = std::chrono::steady_clock::now();
+    do {
+      *groups = count_groups(bytes, data.size(), options);
+      passes++;
+      elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < MIN_SECONDS);
+    const double ns_per_byte = elapsed * 1e9 / (static_cast<double>(passes) * data.size());
+    if (!run || ns_per_byte < best)
+      best = ns_per_byte;
+  }
+  return best;
+}
+
+static std::vector<Input> inputs(int argc, char **argv) {
+  std::vector<Input> inputs;
+  std::mt19937 rng(1);
+
+  Input typical{"typical", ""};
+  while (typical.data.size() < INPUT_SIZE)
+    typical.data += parser_host::typical_frame(false);
+  inputs.push_back(typical);
+  Input random{"random", ""};
+  while (random.data.size() < INPUT_SIZE)
+    random.data += parser_host::random_frame(rng, false);
+  inputs.push_back(random);
+  /* Fields much longer than in typical frames, where the word-at-a-time scan pays off */
+  Input long_values{"long values", ""};
+  while (long_values.data.size() < INPUT_SIZE) {
+    long_values.data += "\x02";
+    for (int i = 0; i < 20; i++)
+      long_values.data += parser_host::make_group("T" + std::to_string(i), std::string(64, 'A' + i), false);
+    long_values.data += "\x03";
+  }
+  inputs.push_back(long_values);
+
+  for (int i = 1; i < argc; i++) {
+    std::ifstream file(argv[i], std::ios::binary);
+    if (!file) {
+      fprintf(stderr, "Cannot read %s\n", argv[i]);
+      continue;
+    }
+    Input capture{argv[i], std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>())};
+    if (capture.data.empty())
+      continue;
+    /* Repeated so that short captures are measured over as many bytes as the other inputs */
+    const std::string once = capture.data;
+    while (capture.data.size() < INPUT_SIZE)
+      capture.data += once;
+    inputs.push_back(capture);
+  }
+  return inputs;
+}
+
+int main(int argc, char **argv) {
+  ReplayOptions all;
+  all.chunks = {CHUNK_SIZE};
+  /* A few sensors, the other groups being skipped once their tag is received */
+  ReplayOptions filtered = all;
+  filtered.tag_filter = true;
+  filtered.accepted.assign(parser_host::typical_tags().begin(), parser_host::typical_tags().begin() + 4);
+
+  printf("%-24s %-9s %10s %10s %12s %12s %8s\n", "input", "mode", "ns/byte", "ns/group", "scalar/byte",
+         "scalar/group", "speedup");
+  for (const auto &input : inputs(argc, argv)) {
+    /* Per group (0xa) of the input, valid or not, handed off or skipped */
+    const size_t input_groups = std::count(input.data.begin(), input.data.end(), '\n');
+    for (const auto *options : {&all, &filtered}) {
+      size_t groups, scalar_groups;
+      const double ns_per_byte = measure(esphome::mk2pvrouter::count_groups, input.data, *options, &groups);
+      const double scalar_per_byte =
+          measure(esphome_scalar::mk2pvrouter::count_groups, input.data, *options, &scalar_groups);
+      const double bytes_per_group = input_groups ? static_cast<double>(input.data.size()) / input_groups : 0.0;
+      printf("%-24s %-9s %10.2f %10.1f %12.2f %12.1f %7.2fx%s\n", input.name.c_str(),
+             options == &all ? "all" : "filtered", ns_per_byte, ns_per_byte * bytes_per_group, scalar_per_byte,
+             scalar_per_byte * bytes_per_group, scalar_per_byte / ns_per_byte,
+             groups == scalar_groups ? "" : " (groups differ)");
+    }
+  }
+  return 0;
+}
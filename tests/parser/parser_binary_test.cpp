@@ -0,0 +1,117 @@
+/*
+ * Host test of the binary frames, with a parser built with MK2PVROUTER_MAX_BINARY_GROUPS: valid
+ * and corrupted frames, IDs without a tag, and the checksum of the ASCII group handed off for each
+ * binary group.
+ */
+
+#include "frames.h"
+#include "parser_driver.h"
+
+#include <cstdio>
+#include <string>
+
+using parser_host::ReplayOptions;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+static std::string replay(const std::string &data, const ReplayOptions &options) {
+  return esphome::mk2pvrouter::replay(reinterpret_cast<const uint8_t *>(data.data()), data.size(), options);
+}
+
+/**
+ * @brief Checksum character of the ASCII group of a tag and value, as forwarded by the stream.
+ */
+static std::string checksum(const std::string &tag, const std::string &val, bool historical) {
+  const std::string group = parser_host::make_group(tag, val, historical);
+  return std::to_string(static_cast<uint8_t>(group[group.size() - 2]));
+}
+
+static ReplayOptions binary_options() {
+  ReplayOptions options;
+  options.crcs = true;
+  options.binary_tags = {{1, "P1"}, {2, "P2"}, {7, "VER"}};
+  return options;
+}
+
+static void test_valid_frame() {
+  for (bool historical : {false, true}) {
+    ReplayOptions options = binary_options();
+    options.historical = historical;
+    const std::string frame = parser_host::binary_frame({{1, 1234}, {2, -567}, {7, 0}});
+
+    CHECK(replay(frame, options) == "start\ngroup P1=1234 crc " + checksum("P1", "1234", historical) +
+                                        "\ngroup P2=-567 crc " + checksum("P2", "-567", historical) +
+                                        "\ngroup VER=0 crc " + checksum("VER", "0", historical) + "\nend\n");
+    options.tag_filter = true;
+    options.accepted = {"P2"};
+    CHECK(replay(frame, options) == "start\ngroup P2=-567 crc " + checksum("P2", "-567", historical) + "\nend\n");
+  }
+  /* Binary and ASCII frames alike */
+  ReplayOptions options = binary_options();
+  const std::string frames = parser_host::binary_frame({{1, 1}}) + "\x02" + parser_host::make_group("P1", "2", false) +
+                             "\x03" + parser_host::binary_frame({});
+  CHECK(replay(frames, options) == "start\ngroup P1=1 crc " + checksum("P1", "1", false) +
+                                       "\nend\nstart\ngroup P1=2 crc " + checksum("P1", "2", false) +
+                                       "\nend\nstart\nend\n");
+}
+
+static void test_unnamed_id() {
+  ReplayOptions options = binary_options();
+
+  CHECK(replay(parser_host::binary_frame({{3, 42}, {1, 2147483647}, {255, -1}}), options) ==
+        "start\ngroup P1=2147483647 crc " + checksum("P1", "2147483647", false) + "\nend\n");
+}
+
+static void test_errors() {
+  ReplayOptions options = binary_options();
+  std::string frame = parser_host::binary_frame({{1, 1234}});
+  const unsigned crc =
+      static_cast<uint8_t>(frame[frame.size() - 2]) | static_cast<uint8_t>(frame[frame.size() - 1]) << 8;
+  const std::string received = std::to_string(crc ^ 1);
+  const std::string expected = std::to_string(crc);
+
+  /* The CRCs of the frame are reported for a mismatch */
+  frame[frame.size() - 2] ^= 1;
+  CHECK(replay(frame, options) == "start\nerror 0 crc " + received + " expected " + expected + "\nend incomplete\n");
+  frame = parser_host::binary_frame({{1, 1234}});
+  frame[3] ^= 1;
+  CHECK(replay(frame, options).find("group") == std::string::npos);
+
+  /* More groups than buffered: the frame is dropped and the next one is received */
+  const std::string too_many = parser_host::binary_frame({{1, 1}, {1, 2}, {1, 3}, {1, 4}, {1, 5}});
+  CHECK(replay(too_many.substr(0, 2), options) == "start\nerror 3\nend incomplete\n");
+  CHECK(replay(too_many.substr(0, 2) + parser_host::binary_frame({{2, 9}}), options) ==
+        "start\nerror 3\nend incomplete\nstart\ngroup P2=9 crc " + checksum("P2", "9", false) + "\nend\n");
+}
+
+static void test_chunking() {
+  const std::string frame = parser_host::binary_frame({{1, 1234}, {2, -567}, {7, 65536}, {9, 3}});
+  ReplayOptions options = binary_options();
+  const std::string whole = replay(frame, options);
+
+  for (size_t chunk = 1; chunk < frame.size(); chunk++) {
+    options.chunks = {chunk};
+    CHECK(replay(frame, options) == whole);
+  }
+}
+
+int main() {
+  test_valid_frame();
+  test_unnamed_id();
+  test_errors();
+  test_chunking();
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "parser_driver.h"
+#include "mk2pvrouter_parser.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace esphome {
+namespace mk2pvrouter {
+
+namespace {
+
+/**
+ * @brief Records the events of a parser as text, or only counts its groups without events.
+ */
+class Recorder : public FrameHandler {
+ public:
+  Recorder(const parser_host::ReplayOptions &options, std::string *events) : options_(options), events_(events) {
+    for (const auto &tag : options.accepted)
+      accepted_hashes_.push_back(hash_tag(tag.c_str(), tag.size()));
+  }
+
+  void on_frame_start() override {
+    if (events_ != nullptr)
+      events_->append("start\n");
+  }
+  bool accept_tag(const char *tag, size_t tag_len, uint32_t tag_hash) override {
+    if (events_ != nullptr && hash_tag(tag, tag_len) != tag_hash)
+      events_->append("bad hash\n");
+    if (options_.accepted.empty())
+      return true;
+    /* Looked up by hash first, as the hub does */
+    for (size_t i = 0; i < accepted_hashes_.size(); i++) {
+      if (accepted_hashes_[i] == tag_hash && options_.accepted[i] == tag)
+        return true;
+    }
+    return false;
+  }
+  void set_parser(const FrameParser *parser) { parser_ = parser; }
+
+  void on_group(const char *tag, size_t tag_len, uint32_t tag_hash, const char *val, size_t val_len) override {
+    groups++;
+    if (events_ == nullptr)
+      return;
+    events_->append("group ").append(tag, tag_len).append("=").append(val, val_len);
+    if (options_.crcs)
+      events_->append(" crc ").append(std::to_string(parser_->get_received_crc()));
+    events_->append("\n");
+    if (hash_tag(tag, tag_len) != tag_hash)
+      events_->append("bad hash\n");
+  }
+  void on_frame_end(bool complete) override {
+    if (events_ != nullptr)
+      events_->append(complete ? "end\n" : "end incomplete\n");
+  }
+  void on_error(ParseError error) override {
+    if (events_ == nullptr)
+      return;
+    events_->append("error ").append(std::to_string(static_cast<int>(error)));
+    if (options_.crcs && error == ParseError::CRC_MISMATCH)
+      events_->append(" crc ")
+          .append(std::to_string(parser_->get_received_crc()))
+          .append(" expected ")
+          .append(std::to_string(parser_->get_calculated_crc()));
+    events_->append("\n");
+  }
+
+  size_t groups{0};
+
+ protected:
+  const parser_host::ReplayOptions &options_;
+  std::string *events_;
+  const FrameParser *parser_{nullptr};
+  std::vector<uint32_t> accepted_hashes_{};
+};
+
+void feed(Recorder &recorder, const uint8_t *data, size_t len, const parser_host::ReplayOptions &options) {
+  FrameParser parser(&recorder);
+  size_t pos = 0;
+  size_t chunk = 0;
+
+  recorder.set_parser(&parser);
+#ifdef MK2PVROUTER_MAX_BINARY_GROUPS
+  std::vector<BinaryTag> binary_tags;
+  for (const auto &tag : options.binary_tags)
+    binary_tags.push_back({tag.first, static_cast<uint8_t>(tag.second.size()),
+                           hash_tag(tag.second.c_str(), tag.second.size()), tag.second.c_str()});
+  parser.set_binary_tags(binary_tags.data(), binary_tags.size());
+#endif
+  parser.set_tag_filter(options.tag_filter);
+  parser.set_checksum_mode(options.historical ? ChecksumMode::HISTORICAL : ChecksumMode::STANDARD);
+  parser.start();
+  while (pos < len) {
+    size_t size = len - pos;
+    if (!options.chunks.empty())
+      size = std::min(std::max<size_t>(options.chunks[chunk++ % options.chunks.size()], 1), size);
+    const size_t end = pos + size;
+    while (pos < end) {
+      pos += parser.feed(data + pos, end - pos);
+      if (parser.is_idle())
+        parser.start();
+    }
+  }
+  recorder.set_parser(nullptr);
+}
+
+}  // namespace
+
+std::string replay(const uint8_t *data, size_t len, const parser_host::ReplayOptions &options) {
+  std::string events;
+  Recorder recorder(options, &events);
+
+  feed(recorder, data, len, options);
+  return events;
+}
+
+size_t count_groups(const uint8_t *data, size_t len, const parser_host::ReplayOptions &options) {
+  Recorder recorder(options, nullptr);
+
+  feed(recorder, data, len, options);
+  return recorder.groups;
+}
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
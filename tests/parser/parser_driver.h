@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+ * Host driver of the frame parser, shared by the test, the benchmark and the fuzzer.
+ *
+ * parser_driver.cpp and the parser are built twice: once with MK2PVROUTER_SWAR, which enables
+ * the word-at-a-time scan, and once without it and with the esphome namespace renamed to
+ * esphome_scalar, for the byte-wise state machine built by default. Both parsers can
+ * then be compared in a single program. A third build, with MK2PVROUTER_MAX_BINARY_GROUPS,
+ * also recognizes the binary frames.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace parser_host {
+
+struct ReplayOptions {
+  /* Ask accept_tag() for each group, as the hub does unless verify_all_crc is set */
+  bool tag_filter{false};
+  bool historical{false};
+  /* Tags accepted by the tag filter, every tag when empty */
+  std::vector<std::string> accepted{};
+  /* Sizes of the successive chunks fed to the parser, cycled, the whole input at once when empty */
+  std::vector<size_t> chunks{};
+  /* Record the received CRC of each group, and both CRCs of each mismatch */
+  bool crcs{false};
+  /* Tags of the IDs of the binary frames, sorted by ID, when built with MK2PVROUTER_MAX_BINARY_GROUPS */
+  std::vector<std::pair<uint8_t, std::string>> binary_tags{};
+};
+
+}  // namespace parser_host
+
+namespace esphome {
+namespace mk2pvrouter {
+
+/**
+ * @brief Feeds an input to a parser, restarting it after each end frame, and records its events.
+ *
+ * @return std::string One line per event: frame start, group, frame end or error.
+ */
+std::string replay(const uint8_t *data, size_t len, const parser_host::ReplayOptions &options);
+/**
+ * @brief Same as replay(), only counting the groups handed off.
+ */
+size_t count_groups(const uint8_t *data, size_t len, const parser_host::ReplayOptions &options);
+
+}  // namespace mk2pvrouter
+}  // namespace esphome
+
+namespace esphome_scalar {
+namespace mk2pvrouter {
+
+std::string replay(const uint8_t *data, size_t len, const parser_host::ReplayOptions &options);
+size_t count_groups(const uint8_t *data, size_t len, const parser_host::ReplayOptions &options);
+
+}  // namespace mk2pvrouter
+}  // namespace esphome_scalar
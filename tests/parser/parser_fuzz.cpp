@@ -0,0 +1,68 @@
+/*
+ * Fuzz target of the frame parser. Built with -fsanitize=fuzzer when the compiler has libFuzzer,
+ * otherwise with a main() replaying the files given on the command line, or random inputs.
+ *
+ * The first two bytes of an input pick the parser options and the chunk size, the rest is fed to
+ * the parser, which must not crash, and whose events must not depend on the chunks, nor on the
+ * word-at-a-time scan.
+ */
+
+#include "frames.h"
+#include "parser_driver.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+
+using parser_host::ReplayOptions;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size < 2)
+    return 0;
+  ReplayOptions options;
+  options.tag_filter = data[0] & 1;
+  options.historical = data[0] & 2;
+  if (data[0] & 4)
+    options.accepted = {"P1", "D1", "M"};
+  const size_t chunk = 1 + data[1] % 64;
+  data += 2;
+  size -= 2;
+
+  const std::string whole = esphome::mk2pvrouter::replay(data, size, options);
+  options.chunks = {chunk};
+  if (esphome::mk2pvrouter::replay(data, size, options) != whole)
+    abort();
+  if (esphome_scalar::mk2pvrouter::replay(data, size, options) != whole)
+    abort();
+  return 0;
+}
+
+#ifndef MK2PVROUTER_LIBFUZZER
+/* Random inputs replayed without arguments */
+static const int RANDOM_INPUTS = 20000;
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::ifstream file(argv[i], std::ios::binary);
+    const std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+  }
+  if (argc > 1)
+    return 0;
+
+  std::mt19937 rng(1);
+  for (int i = 0; i < RANDOM_INPUTS; i++) {
+    std::string input;
+    input += static_cast<char>(rng());
+    input += static_cast<char>(rng());
+    for (size_t frames = 1 + rng() % 3; frames; frames--)
+      input += parser_host::corrupt(parser_host::random_frame(rng, input[0] & 2), rng);
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+  }
+  printf("%d random inputs replayed\n", RANDOM_INPUTS);
+  return 0;
+}
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Host test of the frame parser: decoding of the groups, events independent of how the input
+ * is split into chunks, and the same events with the word-at-a-time scan and byte-wise.
+ */
+
+#include "frames.h"
+#include "parser_driver.h"
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+using parser_host::ReplayOptions;
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+static std::string replay(const std::string &data, const ReplayOptions &options) {
+  return esphome::mk2pvrouter::replay(reinterpret_cast<const uint8_t *>(data.data()), data.size(), options);
+}
+
+static void test_typical_frame() {
+  for (bool historical : {false, true}) {
+    ReplayOptions options;
+    options.historical = historical;
+    const std::string events = replay(parser_host::typical_frame(historical), options);
+
+    CHECK(events.find("error") == std::string::npos);
+    CHECK(events.find("group P2=-567\n") != std::string::npos);
+    CHECK(events.find("group VER=v2.3.1\n") != std::string::npos);
+    CHECK(events.rfind("end\n") == events.size() - 4);
+
+    options.tag_filter = true;
+    options.accepted = {"P1", "M"};
+    CHECK(replay(parser_host::typical_frame(historical), options) == "start\ngroup P1=1234\ngroup M=NORMAL\nend\n");
+  }
+}
+
+static void test_errors() {
+  ReplayOptions options;
+  std::string bad = parser_host::make_group("P1", "12", false);
+  bad[bad.size() - 2] ^= 1;
+
+  CHECK(replay("\x02" + bad + "\x03", options) == "start\nerror 0\nend\n");
+  /* A tag longer than the tag buffer cannot be listened to, it is not an error */
+  const std::string long_tag = parser_host::make_group(std::string(40, 'T'), "1", false);
+  CHECK(replay("\x02" + long_tag + "\x03", options) == "start\nend\n");
+  options.tag_filter = true;
+  CHECK(replay("\x02" + long_tag + "\x03", options) == "start\nend\n");
+}
+
+static void test_chunking() {
+  std::mt19937 rng(1);
+
+  for (int i = 0; i < 5000; i++) {
+    ReplayOptions options;
+    options.historical = rng() % 2;
+    options.tag_filter = rng() % 2;
+    if (rng() % 2)
+      options.accepted = {"P1", "D1", "V3", "M"};
+    std::string data = parser_host::random_frame(rng, options.historical);
+    if (rng() % 2)
+      data = parser_host::corrupt(data, rng);
+    const std::string whole = replay(data, options);
+
+    for (size_t j = 1 + rng() % 8; j; j--)
+      options.chunks.push_back(1 + rng() % 40);
+    if (replay(data, options) != whole) {
+      printf("frame %d: events depend on the chunks\n", i);
+      failures++;
+      return;
+    }
+  }
+}
+
+static void test_scalar_equivalence() {
+  std::mt19937 rng(2);
+
+  for (int i = 0; i < 20000; i++) {
+    ReplayOptions options;
+    options.historical = rng() % 2;
+    options.tag_filter = rng() % 2;
+    if (rng() % 2)
+      options.accepted = {"P1", "D1", "V3", "M"};
+    for (size_t j = 1 + rng() % 8; j; j--)
+      options.chunks.push_back(1 + rng() % 64);
+    std::string data = parser_host::random_frame(rng, options.historical);
+    if (rng() % 2)
+      data = parser_host::corrupt(data, rng);
+    const auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+
+    if (esphome::mk2pvrouter::replay(bytes, data.size(), options) !=
+        esphome_scalar::mk2pvrouter::replay(bytes, data.size(), options)) {
+      printf("frame %d: the word-at-a-time and byte-wise events differ\n", i);
+      failures++;
+      return;
+    }
+  }
+}
+
+int main() {
+  test_typical_frame();
+  test_errors();
+  test_chunking();
+  test_scalar_equivalence();
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}